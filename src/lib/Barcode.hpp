@@ -19,6 +19,12 @@ class Barcode
     public:
     Barcode(int inMismatches) : mismatches(inMismatches) {}
     int mismatches;
+    //row of every pattern in the mismatch histograms of the statistics (see fastqStats), set before mapping (empty if not counted)
+    std::vector<int> statsRows;
+    inline int stats_row(const int& patternIdx) const
+    {
+        return(statsRows.empty() ? -1 : statsRows[patternIdx]);
+    }
     //
     std::string generate_reverse_complement(std::string seq)
     {
@@ -43,8 +49,10 @@ class Barcode
         return newSeq;
     }
     //overwritten function to match sequence pattern(s)
+    //patternIdx is set to the index of the matched pattern (in get_patterns) if given
     virtual bool match_pattern(std::string sequence, const int& offset, int& seq_start, int& seq_end, int& score, std::string& realBarcode, 
-                               int& differenceInBarcodeLength, bool startCorrection = false, bool reverse = false, bool fullLengthMapping = false) = 0;
+                               int& differenceInBarcodeLength, bool startCorrection = false, bool reverse = false, bool fullLengthMapping = false,
+                               int* patternIdx = nullptr) = 0;
     virtual std::vector<std::string> get_patterns() = 0;
     virtual bool is_wildcard() = 0;
     virtual bool is_constant() = 0;
@@ -60,8 +68,9 @@ class ConstantBarcode : public Barcode
     }
     bool match_pattern(std::string sequence, const int& offset, int& seq_start, int& seq_end, int& score, std::string& realBarcode, 
                        int& differenceInBarcodeLength, bool startCorrection = false, bool reverse = false,
-                       bool fullLengthMapping = false)
+                       bool fullLengthMapping = false, int* patternIdx = nullptr)
     {
+        if(patternIdx != nullptr){*patternIdx = 0;}
 
         int tries = differenceInBarcodeLength;
         int tmpOffset = offset;
@@ -174,8 +183,12 @@ class VariableBarcode : public Barcode
         }
     }
     bool match_pattern(std::string sequence, const int& offset, int& seq_start, int& seq_end, int& score, std::string& realBarcode, 
-                       int& differenceInBarcodeLength, bool startCorrection = false,  bool reverse = false, bool fullLengthMapping = false)
+                       int& differenceInBarcodeLength, bool startCorrection = false,  bool reverse = false, bool fullLengthMapping = false,
+                       int* patternIdx = nullptr)
     {
+        //index of realBarcode, set together with it
+        int unusedPatternIdx = 0;
+        int& realBarcodeIdx = (patternIdx != nullptr) ? *patternIdx : unusedPatternIdx;
         int tries = differenceInBarcodeLength;
         int tmpOffset = offset;
         bool offsetShiftBool = false;
@@ -187,7 +200,7 @@ class VariableBarcode : public Barcode
         {
             int tmpNumberOfSameScoreResults = 0;
             bool matchResult = private_match_pattern(sequence, tmpOffset, offsetShiftValue, seq_start, seq_end,score ,
-                                     realBarcode, offsetShiftBool, tmpNumberOfSameScoreResults, differenceInBarcodeLength, reverse, startCorrection);
+                                     realBarcode, realBarcodeIdx, offsetShiftBool, tmpNumberOfSameScoreResults, differenceInBarcodeLength, reverse, startCorrection);
 
             //if we already map sth to 100% don t bother and return true
             if(matchResult && score == 0){return true;}
@@ -245,7 +258,7 @@ class VariableBarcode : public Barcode
 
     // first only for number of skipped bases call a sequences window; if this leads to nothing add more windows until number mismatches in barcode is reached
     bool private_match_pattern(std::string sequence, const int& offset, const int& offsetShiftValue, int& seq_start, int& seq_end, int& score, 
-                               std::string& realBarcode, const bool& offsetShiftBool, int& numberOfSameScoreResults, int& diffEnd,
+                               std::string& realBarcode, int& realBarcodeIdx, const bool& offsetShiftBool, int& numberOfSameScoreResults, int& diffEnd,
                                bool reverse = false, bool startCorrection = false)
     {
         int match_count = 0;
@@ -301,6 +314,7 @@ class VariableBarcode : public Barcode
                     best_end = seq_end;
                     best_score = score;
                     realBarcode = pattern;
+                    realBarcodeIdx = patternIdx;
                     match_count = 1;
                     found_match = true;
                     bestDiff = tmpDiff;
@@ -353,8 +367,10 @@ class WildcardBarcode : public Barcode
     public:
     WildcardBarcode(std::string inPattern, int inMismatches) : pattern(inPattern),Barcode(inMismatches) {}
     bool match_pattern(std::string sequence, const int& offset, int& seq_start, int& seq_end, int& score, std::string& realBarcode, 
-                       int& differenceInBarcodeLength, bool startCorrection = false, bool reverse = false, bool fullLengthMapping = false)
+                       int& differenceInBarcodeLength, bool startCorrection = false, bool reverse = false, bool fullLengthMapping = false,
+                       int* patternIdx = nullptr)
     {
+        if(patternIdx != nullptr){*patternIdx = 0;}
 
         sequence = sequence.substr(offset, pattern.length());
         int end = (sequence.length() < pattern.length()) ? sequence.length() : pattern.length();
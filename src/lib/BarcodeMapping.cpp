@@ -24,10 +24,10 @@ void Mapping<MappingPolicy, FilePolicy>::initializeStats()
     {
         int mismatches = (*patternItr)->mismatches;
         const std::vector<std::string> patterns = (*patternItr)->get_patterns();
+        (*patternItr)->statsRows.clear();
         for(const std::string& pattern : patterns)
         {
-            std::vector<int> mismatchVector(mismatches + 2, 0);
-            stats.mapping_dict.insert(std::make_pair(pattern, mismatchVector));
+            (*patternItr)->statsRows.push_back(stats.add_barcode(pattern, mismatches));
         }
     }
 }
@@ -299,7 +299,32 @@ bool MapEachBarcodeSequentiallyPolicy::split_line_into_barcode_patterns(std::pai
                                         BarcodePatternVectorPtr barcodePatterns,
                                         fastqStats& stats)
 {
-    std::vector<std::string> barcodeList;
+    if(input.mappingCacheSize == 0)
+    {
+        mappingOutcome outcome;
+        map_read(seq.first, input, barcodePatterns, outcome);
+        return(apply_outcome(outcome, barcodeMap, stats));
+    }
+
+    //duplicated reads only replay the outcome of the first read
+    const size_t readHash = MappingCache::hash(seq.first, barcodePatterns.get());
+    std::shared_ptr<const mappingOutcome> cachedOutcome = cache.find(seq.first, barcodePatterns.get(), readHash);
+    if(cachedOutcome != nullptr)
+    {
+        add_to_counter(stats.local().cacheHits);
+        return(apply_outcome(*cachedOutcome, barcodeMap, stats));
+    }
+    add_to_counter(stats.local().cacheMisses);
+    std::shared_ptr<mappingOutcome> outcome = std::make_shared<mappingOutcome>();
+    map_read(seq.first, input, barcodePatterns, *outcome);
+    cache.insert(seq.first, barcodePatterns.get(), readHash, outcome, input.mappingCacheSize);
+    return(apply_outcome(*outcome, barcodeMap, stats));
+}
+
+void MapEachBarcodeSequentiallyPolicy::map_read(const std::string& seq, const input& input, const BarcodePatternVectorPtr& barcodePatterns,
+                                                mappingOutcome& outcome)
+{
+    std::vector<std::string>& barcodeList = outcome.barcodes;
 
     //iterate over BarcodeMappingVector
     int offset = 0;
@@ -328,18 +353,19 @@ bool MapEachBarcodeSequentiallyPolicy::split_line_into_barcode_patterns(std::pai
         bool startCorrection = false;
         if(wildCardToFill){startCorrection = true;} // sart correction checks if we have to move our mapping window to the 5' direction
         // could happen in the case of deletions in the UMI sequence...
-        bool seqToShort = check_if_seq_too_short(offset, seq.first);
+        bool seqToShort = check_if_seq_too_short(offset, seq);
         if(seqToShort)
         {
-            return false;
+            outcome.result = mappingOutcome::tooShort;
+            return;
         }
-        if(!(*patternItr)->match_pattern(seq.first, offset, start, end, score, barcode, differenceInBarcodeLength, startCorrection, false))
+        int patternIdx = 0;
+        if(!(*patternItr)->match_pattern(seq, offset, start, end, score, barcode, differenceInBarcodeLength, startCorrection, false, false, &patternIdx))
         {
-            ++stats.noMatches;
-            return false;
+            outcome.result = mappingOutcome::noMatch;
+            return;
         }
         
-        std::string sequence = seq.first.substr(offset + start, end-start);
         offset += end;
         score_sum += score;
 
@@ -347,9 +373,8 @@ bool MapEachBarcodeSequentiallyPolicy::split_line_into_barcode_patterns(std::pai
         if(input.writeStats)
         {
             //add barcode data to statistics dictionary
-            std::lock_guard<std::mutex> guard(*stats.statsLock);
             int dictvectorIndex = ( (score <= (*patternItr)->mismatches) ? (score) : ( ((*patternItr)->mismatches) + 1) );
-            ++stats.mapping_dict[barcode].at(dictvectorIndex);
+            outcome.mismatches.emplace_back((*patternItr)->stats_row(patternIdx), dictvectorIndex);
         }
         
         //squeeze in the last wildcard match if there was one 
@@ -358,35 +383,48 @@ bool MapEachBarcodeSequentiallyPolicy::split_line_into_barcode_patterns(std::pai
         {
             wildCardToFill = false;
             startCorrection = false;
-            std::string oldWildcardMappedBarcode = seq.first.substr(old_offset, (offset+start-end) - old_offset);
-            //barcodeMap.emplace_back(uniqueChars.  (oldWildcardMappedBarcode));
+            std::string oldWildcardMappedBarcode = seq.substr(old_offset, (offset+start-end) - old_offset);
             barcodeList.push_back(oldWildcardMappedBarcode);
         }
         //add this match to the BarcodeMapping
-        //barcodeMap.emplace_back(std::make_shared<std::string>(mappedBarcode));
         barcodeList.push_back(barcode);
     }
     //if the last barcode was a WIldcard that still has to be added
     if(wildCardToFill == true)
     {
         wildCardToFill = false; // unnecessary, still left to explicitely set to false
-        std::string oldWildcardMappedBarcode = seq.first.substr(old_offset, seq.first.length() - old_offset);
-        //barcodeMap.emplace_back(std::make_shared<std::string>(oldWildcardMappedBarcode));
+        std::string oldWildcardMappedBarcode = seq.substr(old_offset, seq.length() - old_offset);
         barcodeList.push_back(oldWildcardMappedBarcode);
     }
 
-    barcodeMap.addVector(barcodeList);
+    outcome.result = (score_sum == 0) ? mappingOutcome::perfectMatch : mappingOutcome::moderateMatch;
+}
 
-    if(score_sum == 0)
+bool MapEachBarcodeSequentiallyPolicy::apply_outcome(const mappingOutcome& outcome, DemultiplexedReads& barcodeMap, fastqStats& stats)
+{
+    //mismatches of the barcodes that matched (also if a later barcode did not match)
+    for(const std::pair<int, int>& mismatch : outcome.mismatches)
     {
-        ++stats.perfectMatches;
+        stats.add_mismatch(mismatch.first, mismatch.second);
     }
-    else
+
+    switch(outcome.result)
     {
-        ++stats.moderateMatches;
+        case mappingOutcome::tooShort:
+            return false;
+        case mappingOutcome::noMatch:
+            add_to_counter(stats.local().noMatches);
+            return false;
+        case mappingOutcome::perfectMatch:
+            barcodeMap.addVector(outcome.barcodes);
+            add_to_counter(stats.local().perfectMatches);
+            return true;
+        case mappingOutcome::moderateMatch:
+            barcodeMap.addVector(outcome.barcodes);
+            add_to_counter(stats.local().moderateMatches);
+            return true;
     }
-
-    return true;
+    return false;
 }
 
 bool MapEachBarcodeSequentiallyPolicyPairwise::map_forward(const std::string& seq, const input& input, 
@@ -431,7 +469,8 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::map_forward(const std::string& se
         }
 
         //if we did not match a pattern
-        if(!(*patternItr)->match_pattern(seq, offset, start, end, score, barcode, differenceInBarcodeLength, startCorrection, false))
+        int patternIdx = 0;
+        if(!(*patternItr)->match_pattern(seq, offset, start, end, score, barcode, differenceInBarcodeLength, startCorrection, false, false, &patternIdx))
         {
             return false;
         }
@@ -449,9 +488,8 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::map_forward(const std::string& se
         if(input.writeStats)
         {
             //add barcode data to statistics dictionary
-            std::lock_guard<std::mutex> guard(*stats.statsLock);
             int dictvectorIndex = ( (score <= (*patternItr)->mismatches) ? (score) : ( ((*patternItr)->mismatches) + 1) );
-            ++stats.mapping_dict[barcode].at(dictvectorIndex);
+            stats.add_mismatch((*patternItr)->stats_row(patternIdx), dictvectorIndex);
         }
         
         //squeeze in the last wildcard match if there was one 
@@ -525,7 +563,8 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::map_reverse(const std::string& se
         }
 
         //map each pattern with reverse complement
-        if(!(*patternItr)->match_pattern(seq, offset, start, end, score, barcode, differenceInBarcodeLength, startCorrection, true))
+        int patternIdx = 0;
+        if(!(*patternItr)->match_pattern(seq, offset, start, end, score, barcode, differenceInBarcodeLength, startCorrection, true, false, &patternIdx))
         {
             return false;
         }
@@ -543,9 +582,8 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::map_reverse(const std::string& se
         if(input.writeStats)
         {
             //add barcode data to statistics dictionary
-            std::lock_guard<std::mutex> guard(*stats.statsLock);
             int dictvectorIndex = ( (score <= (*patternItr)->mismatches) ? (score) : ( ((*patternItr)->mismatches) + 1) );
-            ++stats.mapping_dict[barcode].at(dictvectorIndex);
+            stats.add_mismatch((*patternItr)->stats_row(patternIdx), dictvectorIndex);
         }
         
         //squeeze in the last wildcard match if there was one 
@@ -608,7 +646,7 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::combine_mapping(DemultiplexedRead
         {
             if(barcodeListFw.at(i) != barcodeListRv.at(j))
             {
-                ++stats.noMatches;
+                add_to_counter(stats.local().noMatches);
                 return false;
             }
             --j;
@@ -634,7 +672,7 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::combine_mapping(DemultiplexedRead
         {
             if(!(barcodePatterns->at(i)->is_constant()))
             {
-                ++stats.noMatches;
+                add_to_counter(stats.local().noMatches);
                 return false;
             }
             barcodeListFw.push_back(barcodePatterns->at(i)->get_patterns().at(0));
@@ -652,11 +690,11 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::combine_mapping(DemultiplexedRead
 
     if(score_sum == 0)
     {
-        ++stats.perfectMatches;
+        add_to_counter(stats.local().perfectMatches);
     }
     else
     {
-        ++stats.moderateMatches;
+        add_to_counter(stats.local().moderateMatches);
     }
     return true;
 }
@@ -685,9 +723,9 @@ bool MapEachBarcodeSequentiallyPolicyPairwise::split_line_into_barcode_patterns(
 
 template <typename MappingPolicy, typename FilePolicy>
 bool Mapping<MappingPolicy, FilePolicy>::demultiplex_read(std::pair<const std::string&, const std::string&> seq, const input& input, 
-                                                          std::atomic<unsigned long long>& count, const unsigned long long& totalReadCount,
                                                           bool guideMapping)
 {
+    TRACE_SPAN("mapping", "demultiplex read");
     //split line into patterns (barcodeMap, barcodePatters, stats are passed as reference or ptr)
     //and can be read by each thread, "addValue" method for barcodeMap is thread safe also for concurrent writing
     bool result;
@@ -698,16 +736,15 @@ bool Mapping<MappingPolicy, FilePolicy>::demultiplex_read(std::pair<const std::s
     else
     {
         result = this->split_line_into_barcode_patterns(seq, input, guideBarcodeMap, guideBarcodePatterns, stats);
-        --stats.noMatches;
+        add_to_counter(stats.local().noMatches, -1);
     }
 
-    //update status bar
-    ++count;
-    if(count%1000==0 && totalReadCount!=ULLONG_MAX) //update at every 1,000th entry
+    //count the read for the progress report (a read mapped again as guide read is already counted)
+    if(!guideMapping)
     {
-        double perc = count/(double)totalReadCount;
-        std::lock_guard<std::mutex> guard(*printProgressLock);
-        printProgress(perc);
+        mappingCounters& counters = stats.local();
+        add_to_counter(counters.reads);
+        add_to_counter(counters.bytes, seq.first.length() + seq.second.length());
     }
 
     return(result);
@@ -784,7 +821,7 @@ bool MapAroundConstantBarcodesAsAnchorPolicy::split_line_into_barcode_patterns(s
 
         //if(start < oldEnd)
         //{
-         //   ++stats.noMatches;
+         //   add_to_counter(stats.local().noMatches);
           //  return false;
         //} //we have in this case barcodes that are non sequential
 
@@ -816,7 +853,7 @@ bool MapAroundConstantBarcodesAsAnchorPolicy::split_line_into_barcode_patterns(s
     }
 
     barcodeMap.addVector(barcodeList);
-    ++stats.perfectMatches;
+    add_to_counter(stats.local().perfectMatches);
 
     return true;
 }
@@ -830,25 +867,39 @@ void Mapping<MappingPolicy, FilePolicy>::run_mapping(const input& input)
     boost::asio::thread_pool pool(input.threads); //create thread pool
 
     //read line by line and add to thread pool
+    runReport.start_stage("read count");
     FilePolicy::init_file(input.inFile, input.reverseFile);
-    std::pair<std::string, std::string> line;
-    std::atomic<unsigned long long> lineCount = 0; //using atomic<int> as thread safe read count
+    runReport.end_stage("read count");
     unsigned long long totalReadCount = FilePolicy::get_read_number();
-
-    while(FilePolicy::get_next_line(line))
+    std::unique_ptr<ProgressReporter> progress = start_progress_report(totalReadCount);
+
+    runReport.start_stage("mapping");
+    const size_t readingStage = runReport.stage("reading and decompression", true);
+    //reads r handed to the workers in batches of views into the blocks of the file (no copy of a read before the worker)
+    const size_t batchSize = batch_size(input);
+    TRACE_BATCH(readBatch, "io", "read batch", std::max<size_t>(1, 4096 / batchSize));
+    std::shared_ptr<sequenceBatch> batch = std::make_shared<sequenceBatch>();
+    while(runReport.time_part(readingStage, [&]{return FilePolicy::get_next_batch(*batch, batchSize);}))
     {
-        //handing over only lineCount as reference, everything else will be copied (Mapping object as handed overr as this-pointer)
+        TRACE_BATCH_NEXT(readBatch);
         //be aware: in default function do not handle guide reads, this is part of the overwritten function in Demultiplexing tool
-        boost::asio::post(pool, std::bind(&Mapping::demultiplex_read, this, line, input, std::ref(lineCount), totalReadCount, false));
+        boost::asio::post(pool, [this, batch, &input]
+        {
+            for_each_batch_read(*batch, [&](std::pair<const std::string&, const std::string&> line){demultiplex_read(line, input, false);});
+        });
+        batch = std::make_shared<sequenceBatch>();
     }
     pool.join();
-    printProgress(1); std::cout << "\n"; // end the progress bar
+    runReport.end_stage("mapping", get_processed_reads(), get_processed_bytes());
+    runReport.add_counts("reading and decompression", get_processed_reads(), get_processed_bytes());
+    progress->stop(); // end the progress bar
     if(totalReadCount != ULLONG_MAX)
     {
-        std::cout << "=>\t READS WITH A MATCHED BARCODE: " << std::to_string((unsigned long long)(100*(stats.perfectMatches)/(double)totalReadCount)) 
-                << "% | MODERATE MATCHES: " << std::to_string((unsigned long long)(100*(stats.moderateMatches)/(double)totalReadCount))
-                << "% | Linker sequences mapped non sequentially (e.g. same linker sequences): " << std::to_string((unsigned long long)(100*(stats.noMatches)/(double)totalReadCount)) << "%\n";
+        std::cout << "=>\t READS WITH A MATCHED BARCODE: " << std::to_string((unsigned long long)(100*(get_perfect_matches())/(double)totalReadCount)) 
+                << "% | MODERATE MATCHES: " << std::to_string((unsigned long long)(100*(get_moderat_matches())/(double)totalReadCount))
+                << "% | Linker sequences mapped non sequentially (e.g. same linker sequences): " << std::to_string((unsigned long long)(100*(get_failed_matches())/(double)totalReadCount)) << "%\n";
     }
+    report_mapping_cache();
     FilePolicy::close_file();
 }
 
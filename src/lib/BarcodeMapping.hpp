@@ -12,24 +12,28 @@
 #include <regex>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <unordered_map>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
 #include <cmath>
+#include <sys/stat.h>
 
 #include "Barcode.hpp"
-#include "seqtk/kseq.h"
+#include "FastqParser.hpp"
 #include "dataTypes.hpp"
-
-KSEQ_INIT(gzFile, gzread)
+#include "RunReport.hpp"
+#include "Trace.hpp"
 
 typedef std::vector< std::shared_ptr<std::string> > SequenceMapping;
-typedef std::vector<const char*> BarcodeMapping;
-typedef std::vector<BarcodeMapping> BarcodeMappingVector;
 
 /** @brief representation of all the mapped barcodes:
- * basically a vector of all reads, where each read itself is a vector of all mapped barcodes
- * This structures stores each barcode only once, handled by the UniqueCharSet, by that
- * most highly redundant datasets can be stored in only a fraction of its origional memory
+ * a table of all reads, where each row stores all mapped barcodes of a read. Every barcode is stored as a 32 bit cell:
+ * short sequences of only ACGT (most CI barcodes and UMIs) r 2 bit packed into the cell itself, all other barcodes are stored 
+ * only once in the UniqueCharSet and the cell holds their handle. By that most highly redundant datasets 
+ * can be stored in only a fraction of its origional memory.
+ * Every thread adding reads writes into its own shard (no lock per read) of contiguous rows. The reads are iterated in place 
+ * (shards in the order the threads added their first read) with for_each_read, the barcodes r only decoded into strings when written.
 **/
 class DemultiplexedReads
 {
@@ -38,52 +42,308 @@ class DemultiplexedReads
         DemultiplexedReads()
         {
             uniqueChars = std::make_shared<UniqueCharSet>();
-            lock = std::make_unique<std::mutex>();
         }
 
-        void addVector(std::vector<std::string> barcodeVector)
+        /** @brief view of one read, only valid as long as no reads r added to the DemultiplexedReads
+        **/
+        class ReadView
         {
-            std::lock_guard<std::mutex> guard(*lock);
-            BarcodeMapping uniqueBarcodeVector;
-            for(std::string barcode : barcodeVector)
+            public:
+                ReadView(const uint32_t* cells, const size_t& width, const DemultiplexedReads& reads) : cells(cells), width(width), reads(reads){}
+
+                inline size_t size() const
+                {
+                    return width;
+                }
+                //append the barcode at position i to the string
+                inline void append_barcode(const size_t& i, std::string& barcode) const
+                {
+                    reads.decode_barcode(cells[i], barcode);
+                }
+                inline std::string barcode(const size_t& i) const
+                {
+                    std::string barcode;
+                    reads.decode_barcode(cells[i], barcode);
+                    return barcode;
+                }
+
+            private:
+                const uint32_t* cells;
+                size_t width;
+                const DemultiplexedReads& reads;
+        };
+
+        void addVector(const std::vector<std::string>& barcodeVector)
+        {
+            //the UniqueCharSet is thread safe, the read is added to the shard of this thread
+            Shard& shard = shards.local();
+            if(shard.width == 0)
+            {
+                shard.width = barcodeVector.size();
+            }
+            else if(shard.width != barcodeVector.size())
+            {
+                std::cerr << "ERROR: A read has " << barcodeVector.size() << " barcodes instead of " << shard.width << "\n";
+                exit(EXIT_FAILURE);
+            }
+            for(const std::string& barcode : barcodeVector)
             {
-                uniqueBarcodeVector.emplace_back(uniqueChars->getUniqueChar(barcode.c_str()));
+                shard.cells.push_back(encode_barcode(barcode));
             }
-            mappedBarcodes.push_back(uniqueBarcodeVector);
         }
 
+        //number of reads, must not be called while threads r still adding reads
         const size_t size()
         {
-            return mappedBarcodes.size();
+            size_t reads = 0;
+            shards.for_each([&](const Shard& shard)
+            {
+                if(shard.width > 0){reads += shard.cells.size() / shard.width;}
+            });
+            return reads;
         }
 
-        const BarcodeMapping at(const int& i)
+        /** @brief iterate over all reads without copying them, func is called with a ReadView for every read. 
+         * Must not be called while threads r still adding reads
+        **/
+        template<typename Func>
+        void for_each_read(Func func) const
         {
-            return(mappedBarcodes.at(i));
+            shards.for_each([&](const Shard& shard)
+            {
+                for(size_t rowStart = 0; rowStart < shard.cells.size(); rowStart += shard.width)
+                {
+                    func(ReadView(shard.cells.data() + rowStart, shard.width, *this));
+                }
+            });
         }
 
-        const BarcodeMappingVector get_all_reads()
+        /** @brief iterate over all distinct reads (same barcodes in all columns, e.g. PCR duplicates), func is called with a ReadView and the number
+         * of identical reads, in the order of the first occurence of every read in for_each_read. Must not be called while threads r still adding reads
+        **/
+        template<typename Func>
+        void for_each_unique_read(Func func) const
         {
-            return(mappedBarcodes);
+            //every barcode is always stored in the same cell, identical reads therefore have identical rows in all shards
+            std::unordered_map<rowKey, size_t, rowKeyHash> rowIndex;
+            std::vector<std::pair<rowKey, unsigned long long>> uniqueReads;
+            shards.for_each([&](const Shard& shard)
+            {
+                for(size_t rowStart = 0; rowStart < shard.cells.size(); rowStart += shard.width)
+                {
+                    rowKey row{shard.cells.data() + rowStart, shard.width};
+                    std::pair<std::unordered_map<rowKey, size_t, rowKeyHash>::iterator, bool> inserted = rowIndex.emplace(row, uniqueReads.size());
+                    if(inserted.second)
+                    {
+                        uniqueReads.push_back(std::make_pair(row, 0));
+                    }
+                    ++uniqueReads[inserted.first->second].second;
+                }
+            });
+            for(const std::pair<rowKey, unsigned long long>& read : uniqueReads)
+            {
+                func(ReadView(read.first.cells, read.first.width, *this), read.second);
+            }
         }
 
     private:
-        BarcodeMappingVector mappedBarcodes;
+
+        //reads of one thread, every row has width cells
+        struct Shard
+        {
+            std::vector<uint32_t> cells;
+            size_t width = 0;
+        };
+
+        //a row of cells in a shard, equal if all cells r equal
+        struct rowKey
+        {
+            const uint32_t* cells;
+            size_t width;
+
+            bool operator==(const rowKey& other) const
+            {
+                return(width == other.width && std::memcmp(cells, other.cells, width * sizeof(uint32_t)) == 0);
+            }
+        };
+        struct rowKeyHash
+        {
+            size_t operator()(const rowKey& row) const
+            {
+                uint64_t hash = row.width;
+                for(size_t i = 0; i < row.width; ++i)
+                {
+                    hash = (hash ^ row.cells[i]) * 0x9E3779B97F4A7C15ULL;
+                }
+                return(hash ^ (hash >> 32));
+            }
+        };
+
+        //cells with the highest bit set store a 2 bit packed sequence and its length, 
+        //all other cells store a charHandle of the UniqueCharSet
+        static const uint32_t packedFlag = uint32_t(1) << 31;
+        static const unsigned int packedLengthShift = 26;
+        static const uint32_t packedSequenceMask = (uint32_t(1) << packedLengthShift) - 1;
+        static const size_t maxPackedLength = packedLengthShift / 2;
+
+        uint32_t encode_barcode(const std::string& barcode)
+        {
+            if(barcode.size() <= maxPackedLength)
+            {
+                uint32_t packed = 0;
+                bool onlyBases = true;
+                for(const char& base : barcode)
+                {
+                    uint32_t code;
+                    switch(base)
+                    {
+                        case 'A': code = 0; break;
+                        case 'C': code = 1; break;
+                        case 'G': code = 2; break;
+                        case 'T': code = 3; break;
+                        default: onlyBases = false; code = 0;
+                    }
+                    packed = (packed << 2) | code;
+                }
+                if(onlyBases)
+                {
+                    return(packedFlag | (uint32_t(barcode.size()) << packedLengthShift) | packed);
+                }
+            }
+            return(uniqueChars->getHandle(barcode));
+        }
+
+        inline void decode_barcode(const uint32_t& cell, std::string& barcode) const
+        {
+            if(cell & packedFlag)
+            {
+                static const char bases[4] = {'A', 'C', 'G', 'T'};
+                const size_t length = (cell & ~packedFlag) >> packedLengthShift;
+                for(size_t i = length; i > 0; --i)
+                {
+                    barcode.push_back(bases[(cell >> (2 * (i - 1))) & 3]);
+                }
+            }
+            else
+            {
+                barcode.append(uniqueChars->getChar(cell));
+            }
+        }
+
+        //reads of each thread
+        ThreadLocalShards<Shard> shards;
+
         //all the string inside this class are stored only once, 
         //set of all the unique barcodes we use, and we only pass pointers to those
         std::shared_ptr<UniqueCharSet> uniqueChars;
-        std::unique_ptr<std::mutex> lock;  
 
 };
 
+//everything the sequential mapping of a read does: the mapped barcodes, the counter of the read and the mismatches
+//of every matched barcode (only stored if statistics r written)
+struct mappingOutcome
+{
+    enum Result {tooShort, noMatch, perfectMatch, moderateMatch};
+    Result result = tooShort;
+    std::vector<std::string> barcodes;
+    std::vector<std::pair<int, int>> mismatches; // (row in the statistics, mismatch index)
+};
+
+/** @brief concurrent cache of the mapping outcome of whole reads: PCR duplicates r byte identical, so a read that was already
+ * mapped skips all the pattern matching. Reads r cached together with the barcode patterns they were mapped to (AB and guide patterns).
+ * The cache is split into stripes with their own lock (the stripe is chosen by the hash of the read, like for the UniqueCharSet),
+ * a stripe that reached its share of the capacity is cleared, so that the cache follows the duplicates of the current part of the file.
+ **/
+class MappingCache
+{
+    public:
+        MappingCache() : stripes(new Stripe[stripeCount]){}
+        MappingCache(const MappingCache&) = delete;
+        MappingCache& operator=(const MappingCache&) = delete;
+
+        //hash of a read (and the patterns it is mapped to), the lower bits choose the stripe, the map uses all bits
+        static size_t hash(const std::string_view& read, const BarcodePatternVector* patterns)
+        {
+            return(std::hash<std::string_view>()(read) ^ (std::hash<const void*>()(patterns) * 0x9E3779B97F4A7C15ULL));
+        }
+
+        //returns the cached outcome or nullptr, the read is not copied (the key only views it)
+        std::shared_ptr<const mappingOutcome> find(const std::string_view& read, const BarcodePatternVector* patterns, const size_t& readHash)
+        {
+            Stripe& stripe = stripes[readHash & (stripeCount - 1)];
+            TRACE_LOCK_GUARD(guard, stripe.lock, "MappingCache stripe");
+            std::unordered_map<cacheKey, cacheEntry, cacheKeyHash>::const_iterator it = stripe.outcomes.find(cacheKey{readHash, patterns, read});
+            if(it == stripe.outcomes.end()){return nullptr;}
+            return(it->second.outcome);
+        }
+
+        //readHash is the hash of the failed find, the read is copied only here
+        void insert(const std::string_view& read, const BarcodePatternVector* patterns, const size_t& readHash,
+                    const std::shared_ptr<const mappingOutcome>& outcome, const unsigned long long& capacity)
+        {
+            Stripe& stripe = stripes[readHash & (stripeCount - 1)];
+            TRACE_LOCK_GUARD(guard, stripe.lock, "MappingCache stripe");
+            if(stripe.outcomes.size() >= std::max(1ULL, capacity / stripeCount))
+            {
+                stripe.outcomes.clear();
+            }
+            std::unique_ptr<const std::string> ownedRead = std::make_unique<const std::string>(read);
+            const std::string_view ownedView(*ownedRead);
+            stripe.outcomes.emplace(cacheKey{readHash, patterns, ownedView}, cacheEntry{std::move(ownedRead), outcome});
+        }
+
+    private:
+        //the read of a stored key views the string owned by its entry (heap allocated, so it does not move with the entry),
+        //lookups use the same key type viewing the read of the caller
+        struct cacheKey
+        {
+            size_t hash;
+            const BarcodePatternVector* patterns;
+            std::string_view read;
+            bool operator==(const cacheKey& other) const
+            {
+                return(hash == other.hash && patterns == other.patterns && read == other.read);
+            }
+        };
+        struct cacheKeyHash
+        {
+            size_t operator()(const cacheKey& key) const
+            {
+                return key.hash;
+            }
+        };
+        struct cacheEntry
+        {
+            std::unique_ptr<const std::string> read;
+            std::shared_ptr<const mappingOutcome> outcome;
+        };
+
+        struct Stripe
+        {
+            std::mutex lock;
+            std::unordered_map<cacheKey, cacheEntry, cacheKeyHash> outcomes;
+        };
+        static const size_t stripeCount = 64;
+        std::unique_ptr<Stripe[]> stripes;
+};
+
 /** @brief mapping sequentially each barcode leaving no pattern out,
  *if a pattern can not be found the read is discarded
+ * @details if input.mappingCacheSize is set the outcome of every read is cached (see MappingCache) and duplicated reads only replay it
  **/
 class MapEachBarcodeSequentiallyPolicy
 {
     public:
         bool split_line_into_barcode_patterns(std::pair<const std::string&, const std::string&> seq, const input& input, DemultiplexedReads& barcodeMap,
                                       BarcodePatternVectorPtr barcodePatterns, fastqStats& stats);
+
+    private:
+        //map all patterns to the read without changing the barcodeMap or stats
+        void map_read(const std::string& seq, const input& input, const BarcodePatternVectorPtr& barcodePatterns, mappingOutcome& outcome);
+        //add the outcome of a read to the barcodeMap and stats
+        bool apply_outcome(const mappingOutcome& outcome, DemultiplexedReads& barcodeMap, fastqStats& stats);
+
+        MappingCache cache;
 };
 
 /** @brief like the sequential barcode mapping policy, for paired-end reads
@@ -130,37 +390,39 @@ class MapAroundConstantBarcodesAsAnchorPolicy
                                     int& barcodePosition, int& skippedBarcodes);
 };
 
-/// parser policy for txt files
+/// parser policy for txt files (one read per line)
 class ExtractLinesFromTxtFilesPolicy
 {
     public:
     void init_file(const std::string& fwFile, const std::string& rvFile)
-    {       
-        //no error handling for txt file right now
-        fileStream.open(fwFile);
+    {
+        reader.open(fwFile, FastqBlockReader::Format::line);
 
-        totalReads = std::count(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>(), '\n');
-        fileStream.clear();
-        fileStream.seekg(0);
+        totalReads = 0;
+        std::string_view sequence;
+        while(reader.next_record(sequence)){++totalReads;}
+        reader.rewind();
     }
 
     bool get_next_line(std::pair<std::string, std::string>& line)
-    {   bool returnValue = true;
-        if(!std::getline(fileStream, line.first))
-        {
-            returnValue = false;
-        }
-        if(returnValue)
-        {
-            line.first.erase(std::remove(line.first.begin(), line.first.end(), '\n'), line.first.end());
-        }
+    {
+        std::string_view sequence;
+        if(!reader.next_record(sequence)){return false;}
+        line.first.assign(sequence);
+        return true;
+    }
 
-        return(returnValue);
+    //the next (at most maxReads) reads as views into the blocks of the file
+    bool get_next_batch(sequenceBatch& batch, const size_t& maxReads)
+    {
+        batch.clear();
+        while(batch.size() < maxReads && reader.read_into(batch, batch.forward)){}
+        return(batch.size() > 0);
     }
 
     void close_file()
     {
-        fileStream.close();
+        reader.close();
     }
 
     unsigned long long get_read_number()
@@ -168,7 +430,7 @@ class ExtractLinesFromTxtFilesPolicy
         return totalReads;
     }
     
-    std::ifstream fileStream;
+    FastqBlockReader reader;
     unsigned long long totalReads;
 };
 
@@ -179,57 +441,47 @@ class ExtractLinesFromFastqFilePolicy
 
     void init_file(const std::string& fwFile, const std::string& rvFile)
     {
-        fp = gzopen(fwFile.c_str(),"r");
-        if(fp == Z_NULL)
+        reader.open(fwFile);
+
+        //reads from a named pipe (e.g. streamed from the read generator) can not be counted in advance
+        struct stat fileStat;
+        if(stat(fwFile.c_str(), &fileStat) == 0 && !S_ISREG(fileStat.st_mode))
         {
-            std::string errMess = "Invalid file: " + fwFile;
-            throw std::domain_error(errMess);
-            exit(EXIT_FAILURE);
+            totalReads = ULLONG_MAX;
+            return;
         }
-        ks = kseq_init(fp);
         totalReads = 0;
-        std::pair<std::string, std::string> line;
-        while(get_next_line(line))
-        {
-            if(totalReads == ULLONG_MAX)
-            {
-                std::cout << "WARNING: Analysing more than " << std::to_string(ULLONG_MAX) << " reads. There will be no status update\n";
-                gzrewind(fp);
-                ks = kseq_init(fp);
-                return;
-            }
-            ++totalReads;
-        }
-        gzrewind(fp);
-        ks = kseq_init(fp);
+        std::string_view sequence;
+        while(reader.next_record(sequence)){++totalReads;}
+        reader.rewind();
     }
 
     bool get_next_line(std::pair<std::string, std::string>& line, bool reverse = false)
     {
-        if(kseq_read(ks) < 0)
-        {
-            if(strlen(ks->seq.s) != strlen(ks->qual.s))
-            {
-                std::cout << "Warning: base quality and read are of different length!\n";
-                exit(EXIT_FAILURE);
-            }
-            return false;
-        }
+        std::string_view sequence;
+        if(!reader.next_record(sequence)){return false;}
         if(!reverse)
         {
-            line.first = std::string(ks->seq.s);
+            line.first.assign(sequence);
         }
         else
         {
-            line.second = std::string(ks->seq.s);
+            line.second.assign(sequence);
         }
         return true;
     }
 
+    //the next (at most maxReads) reads as views into the blocks of the file
+    bool get_next_batch(sequenceBatch& batch, const size_t& maxReads)
+    {
+        batch.clear();
+        while(batch.size() < maxReads && reader.read_into(batch, batch.forward)){}
+        return(batch.size() > 0);
+    }
+
     void close_file()
     {
-        kseq_destroy(ks);
-        gzclose(fp);
+        reader.close();
     }
 
     unsigned long long get_read_number()
@@ -237,10 +489,8 @@ class ExtractLinesFromFastqFilePolicy
         return totalReads;
     }
 
-    kseq_t* ks;
+    FastqBlockReader reader;
     unsigned long long totalReads;
-    gzFile fp;
-
 };
 
 class ExtractLinesFromFastqFilePolicyPairedEnd
@@ -260,6 +510,21 @@ class ExtractLinesFromFastqFilePolicyPairedEnd
             return(fwBool&&rvBool);
         }
 
+        //forward and reverse reads r added in pairs (the batch stops at the end of the shorter file)
+        bool get_next_batch(sequenceBatch& batch, const size_t& maxReads)
+        {
+            batch.clear();
+            while(batch.size() < maxReads && fwFileManager.reader.read_into(batch, batch.forward))
+            {
+                if(!rvFileManager.reader.read_into(batch, batch.reverse))
+                {
+                    batch.forward.pop_back();
+                    break;
+                }
+            }
+            return(batch.size() > 0);
+        }
+
         void close_file()
         {
             fwFileManager.close_file();
@@ -281,7 +546,7 @@ class ExtractLinesFromFastqFilePolicyPairedEnd
  * MapEachBarcodeSequentiallyPolicy
  * @param FilePolicy: the policy used for file reading, txt or fastq(.gz) files
  * @details usage: call the 'run' method, to perform the barcode mapping, calling then get_demultiplexed_reads returns
- * all the mapped barcodes per read as a BarcodeMappingVector, careful, this data is only valid as long as the Mapping is
+ * all the mapped barcodes per read as DemultiplexedReads, careful, this data is only valid as long as the Mapping is
  **/
 template<typename MappingPolicy, typename FilePolicy>
 class Mapping : protected MappingPolicy, protected FilePolicy
@@ -292,39 +557,47 @@ class Mapping : protected MappingPolicy, protected FilePolicy
         {
             barcodeMap = DemultiplexedReads();
             guideBarcodeMap = DemultiplexedReads();
-            printProgressLock = std::make_unique<std::mutex>();
-            stats.statsLock = std::make_unique<std::mutex>();
         }
 
-        /** @brief returns our mapped reads, its a vector (for all raeds) of a vector (for all barcodes sequentially)
-         * of const char*, only valid as long as Mapping object - handle with care!!!!
+        /** @brief returns our mapped reads, a table of all reads (iterate them with for_each_read)
+         * only valid as long as Mapping object - handle with care!!!!
          **/
-        const BarcodeMappingVector get_demultiplexed_ab_reads()
+        const DemultiplexedReads& get_demultiplexed_ab_reads() const
         {
-            return(barcodeMap.get_all_reads());
+            return(barcodeMap);
         }
-        const BarcodeMappingVector get_demultiplexed_guide_reads()
+        const DemultiplexedReads& get_demultiplexed_guide_reads() const
         {
-            return(guideBarcodeMap.get_all_reads());
+            return(guideBarcodeMap);
         }
         ///number of perfect matches
         const unsigned long long get_perfect_matches()
         {
-            return stats.perfectMatches;
+            return stats.total(&mappingCounters::perfectMatches);
         }
         ///number of matches with mismatches
         const unsigned long long get_moderat_matches()
         {
-            return stats.moderateMatches;
+            return stats.total(&mappingCounters::moderateMatches);
         }
         ///number of failed matches
         const unsigned long long get_failed_matches()
         {
-            return stats.noMatches;
+            return stats.total(&mappingCounters::noMatches);
+        }
+        ///number of reads and their bases processed so far
+        const unsigned long long get_processed_reads() const
+        {
+            return stats.total(&mappingCounters::reads);
+        }
+        const unsigned long long get_processed_bytes() const
+        {
+            return stats.total(&mappingCounters::bytes);
         }
         ///the dictionary of mismatches per barcode
         const std::map<std::string, std::vector<int> > get_mismatch_dict()
         {
+            stats.merge_mismatch_histograms();
             return stats.mapping_dict;
         }
 
@@ -356,8 +629,6 @@ class Mapping : protected MappingPolicy, protected FilePolicy
 
         //statistics of the mapping
         fastqStats stats;
-        //lock for update bar
-        std::unique_ptr<std::mutex> printProgressLock;  
 
     protected:
 
@@ -378,10 +649,61 @@ class Mapping : protected MappingPolicy, protected FilePolicy
         //basically it is a vector of Barcode objects, this function calls 'parse_barcode_data' and return a vector of
         //pairs that hold <barcode-regex, char determining the kind of barcode> with kind of barcode beeing e.g. a variable, constant, etc.
         std::vector<std::pair<std::string, char> > generate_barcode_patterns(const input& input);
-        //wrapper to call the actual mapping function on one read and updates the status bar
+        //wrapper to call the actual mapping function on one read and count the processed reads for the progress report
         bool demultiplex_read(std::pair<const std::string&, const std::string&>  seq, const input& input, 
-                              std::atomic<unsigned long long>& count, const unsigned long long& totalReadCount,
                               bool guideMapping);
+        //report progress of the mapping from a seperate thread (until the reporter is stopped or destroyed)
+        std::unique_ptr<ProgressReporter> start_progress_report(const unsigned long long& totalReadCount)
+        {
+            return std::make_unique<ProgressReporter>([this]{return get_processed_reads();}, totalReadCount,
+                                                      [this]{return get_processed_bytes();});
+        }
         //run the actual mapping
         void run_mapping(const input& input);
+
+        //number of reads of a batch handed to a worker: at most a share of the reads that may be queued (fastqReadBucketSize)
+        static size_t batch_size(const input& input)
+        {
+            const size_t maxBatchSize = 4096;
+            if(input.fastqReadBucketSize <= 0){return maxBatchSize;}
+            return(std::clamp<size_t>(input.fastqReadBucketSize / std::max(1, input.threads), 1, maxBatchSize));
+        }
+        //call func(std::pair<const std::string&, const std::string&>) for every read of a batch, the views r copied into
+        //strings of the worker thread that r reused for all reads (the mapping policies work on strings)
+        template<typename Func>
+        static void for_each_batch_read(const sequenceBatch& batch, Func func)
+        {
+            static thread_local std::string forward;
+            static thread_local std::string reverse;
+            reverse.clear();
+            for(size_t i = 0; i < batch.size(); ++i)
+            {
+                forward.assign(batch.forward[i]);
+                if(!batch.reverse.empty()){reverse.assign(batch.reverse[i]);}
+                func(std::pair<const std::string&, const std::string&>(forward, reverse));
+            }
+        }
+
+        //stages of the mapping (read count, reading and decompression, mapping, writing), written by the tools next to their output
+        RunReport runReport;
+        //print the hit rate of the mapping cache and add it to the run report (if the cache was used)
+        void report_mapping_cache()
+        {
+            const unsigned long long hits = stats.total(&mappingCounters::cacheHits);
+            const unsigned long long lookups = hits + stats.total(&mappingCounters::cacheMisses);
+            if(lookups == 0){return;}
+            std::cout << "=>\tMAPPING CACHE HITS: " << std::to_string((unsigned long long)(100*hits/(double)lookups)) << "% (" << hits << " of " << lookups << " lookups)\n";
+            runReport.set_counter("mappingCacheHits", hits);
+            runReport.set_counter("mappingCacheLookups", lookups);
+            runReport.set_counter("mappingCacheHitRate", hits/(double)lookups);
+        }
+        //adds the input files and the processed reads to the run report and writes it next to the output
+        void write_run_report(const input& input, const std::vector<std::string>& outputFiles)
+        {
+            runReport.add_input_file(input.inFile);
+            runReport.add_input_file(input.reverseFile);
+            for(const std::string& outputFile : outputFiles){runReport.add_output_file(outputFile);}
+            runReport.set_total_reads(get_processed_reads());
+            runReport.write(input.outFile);
+        }
 };
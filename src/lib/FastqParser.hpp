@@ -0,0 +1,306 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Parser of fastq(.gz) and txt (one read per line) files without a copy per read: the decompressed input is read in large blocks,
+ * record boundaries r found with a SIMD search for newlines and reads r string_views into their block.
+ * Blocks r refcounted, every batch of reads handed to a worker keeps the blocks of its reads alive, and a block returns to the
+ * pool of its reader once the last batch is done (buffers r reused, there is no allocation per read or per block).
+ */
+
+//position of the first '\n' in [begin, end), or end
+inline const char* find_newline(const char* begin, const char* end)
+{
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while(end - begin >= 16)
+    {
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), newline));
+        if(mask != 0)
+        {
+            return(begin + __builtin_ctz(mask));
+        }
+        begin += 16;
+    }
+#endif
+    const void* found = std::memchr(begin, '\n', end - begin);
+    return((found == nullptr) ? end : static_cast<const char*>(found));
+}
+
+//a buffer of decompressed input
+struct ReadBlock
+{
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    size_t size = 0;
+};
+
+/** @brief hands out blocks as shared_ptr, a block is returned to the pool (not freed) when its last reference is gone.
+ * The blocks keep the pool alive, so they can outlive the reader.
+ **/
+class ReadBlockPool : public std::enable_shared_from_this<ReadBlockPool>
+{
+    public:
+        std::shared_ptr<ReadBlock> get(const size_t& capacity)
+        {
+            std::unique_ptr<ReadBlock> block;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if(!freeBlocks.empty())
+                {
+                    block = std::move(freeBlocks.back());
+                    freeBlocks.pop_back();
+                }
+            }
+            if(!block){block = std::make_unique<ReadBlock>();}
+            if(block->capacity < capacity)
+            {
+                block->data.reset(new char[capacity]);
+                block->capacity = capacity;
+            }
+            block->size = 0;
+
+            std::shared_ptr<ReadBlockPool> pool = shared_from_this();
+            return(std::shared_ptr<ReadBlock>(block.release(), [pool](ReadBlock* returnedBlock){pool->put(returnedBlock);}));
+        }
+
+    private:
+        void put(ReadBlock* block)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            freeBlocks.emplace_back(block);
+        }
+
+        std::mutex lock;
+        std::vector<std::unique_ptr<ReadBlock>> freeBlocks;
+};
+
+//reads handed to a worker at once: views into the blocks they were parsed from, the batch keeps these blocks alive
+struct sequenceBatch
+{
+    std::vector<std::shared_ptr<ReadBlock>> blocks;
+    std::vector<std::string_view> forward;
+    std::vector<std::string_view> reverse; // only for paired-end reads
+
+    inline size_t size() const
+    {
+        return forward.size();
+    }
+    void clear()
+    {
+        blocks.clear();
+        forward.clear();
+        reverse.clear();
+    }
+};
+
+/** @brief reads the records of a (gzipped) file block by block. A fastq record has four lines (header starting with '@', sequence,
+ * '+' line, quality of the same length as the sequence), in line mode every line is a read (txt files).
+ * Sequences and qualities wrapped over several lines (multi-line fastq) r not supported, they r detected and reported as such.
+ * Records that r cut by the end of a block r copied to the beginning of the next block, blocks grow for records longer than a block.
+ **/
+class FastqBlockReader
+{
+    public:
+        enum class Format {fastq, line};
+
+        void open(const std::string& file, const Format& recordFormat = Format::fastq)
+        {
+            fileName = file;
+            format = recordFormat;
+            fp = gzopen(fileName.c_str(), "r");
+            if(fp == Z_NULL)
+            {
+                std::string errMess = "Invalid file: " + fileName;
+                throw std::domain_error(errMess);
+            }
+            gzbuffer(fp, 1 << 17);
+            reset();
+        }
+
+        void rewind()
+        {
+            gzrewind(fp);
+            reset();
+        }
+
+        void close()
+        {
+            if(fp != Z_NULL){gzclose(fp);}
+            fp = Z_NULL;
+            current.reset();
+        }
+
+        //the sequence of the next read, the view is valid as long as a reference to its block (current_block) is kept
+        bool next_record(std::string_view& sequence)
+        {
+            while(true)
+            {
+                if(current)
+                {
+                    const char* data = current->data.get();
+                    const char* end = data + current->size;
+                    const char* begin = data + position;
+                    //empty lines between fastq records (and at the end of the file) r skipped
+                    if(format == Format::fastq)
+                    {
+                        while(begin < end && (*begin == '\n' || *begin == '\r')){++begin;}
+                        position = begin - data;
+                    }
+
+                    const size_t lines = (format == Format::fastq) ? 4 : 1;
+                    const char* lineEnds[4];
+                    const char* lineStart = begin;
+                    size_t foundLines = 0;
+                    while(foundLines < lines)
+                    {
+                        const char* lineEnd = find_newline(lineStart, end);
+                        if(lineEnd == end){break;}
+                        lineEnds[foundLines++] = lineEnd;
+                        lineStart = lineEnd + 1;
+                    }
+
+                    if(foundLines == lines)
+                    {
+                        position = lineStart - data;
+                        sequence = make_record(begin, lineEnds);
+                        return true;
+                    }
+                    if(endOfFile)
+                    {
+                        if(begin == end){return false;}
+                        //the last line of the file has no newline
+                        if(foundLines == lines - 1)
+                        {
+                            lineEnds[foundLines] = end;
+                            position = current->size;
+                            sequence = make_record(begin, lineEnds);
+                            return true;
+                        }
+                        std::cerr << "ERROR: Truncated fastq record after read " << records << " in " << fileName << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                read_block();
+            }
+        }
+
+        inline const std::shared_ptr<ReadBlock>& current_block() const
+        {
+            return current;
+        }
+
+        //add the next read to reads (and its block to the batch)
+        bool read_into(sequenceBatch& batch, std::vector<std::string_view>& reads)
+        {
+            std::string_view sequence;
+            if(!next_record(sequence)){return false;}
+            if(std::find(batch.blocks.begin(), batch.blocks.end(), current) == batch.blocks.end())
+            {
+                batch.blocks.push_back(current);
+            }
+            reads.push_back(sequence);
+            return true;
+        }
+
+    private:
+        void reset()
+        {
+            current.reset();
+            position = 0;
+            endOfFile = false;
+            records = 0;
+        }
+
+        //validates the record and returns its sequence, lineEnds r the ends of its lines
+        std::string_view make_record(const char* begin, const char** lineEnds)
+        {
+            ++records;
+            if(format == Format::line)
+            {
+                return(std::string_view(begin, lineEnds[0] - begin));
+            }
+
+            const char* sequenceStart = lineEnds[0] + 1;
+            const char* qualityStart = lineEnds[2] + 1;
+            size_t sequenceLength = trimmed_length(sequenceStart, lineEnds[1]);
+            size_t qualityLength = trimmed_length(qualityStart, lineEnds[3]);
+            if(*begin != '@')
+            {
+                std::cerr << "ERROR: Read " << records << " in " << fileName << " is no fastq record (four lines starting with '@' and '+')\n";
+                exit(EXIT_FAILURE);
+            }
+            //a header followed by more than one sequence line: the third line is the rest of the sequence
+            if(*(lineEnds[1] + 1) != '+')
+            {
+                std::cerr << "ERROR: Read " << records << " in " << fileName << " has no '+' line after its sequence line, "
+                          << "fastq files with sequences wrapped over several lines are not supported (unwrap them first, e.g. with seqtk seq)\n";
+                exit(EXIT_FAILURE);
+            }
+            if(sequenceLength != qualityLength)
+            {
+                std::cerr << "ERROR: Base quality and read are of different length for read " << records << " in " << fileName;
+                //the rest of a wrapped quality would follow in the next line
+                if(qualityLength < sequenceLength){std::cerr << " (fastq files with qualities wrapped over several lines are not supported)";}
+                std::cerr << "\n";
+                exit(EXIT_FAILURE);
+            }
+            return(std::string_view(sequenceStart, sequenceLength));
+        }
+
+        //length of a line without a windows line ending
+        inline size_t trimmed_length(const char* start, const char* end) const
+        {
+            if(end > start && *(end - 1) == '\r'){--end;}
+            return(end - start);
+        }
+
+        //a new block with the rest of the current block (an incomplete record), filled up from the file
+        void read_block()
+        {
+            const size_t rest = current ? current->size - position : 0;
+            std::shared_ptr<ReadBlock> block = pool->get(std::max(blockSize, 2 * rest));
+            if(rest > 0)
+            {
+                std::memcpy(block->data.get(), current->data.get() + position, rest);
+            }
+            block->size = rest;
+
+            const int readBytes = gzread(fp, block->data.get() + rest, block->capacity - rest);
+            if(readBytes < 0)
+            {
+                int errorNumber;
+                std::cerr << "ERROR: Could not read " << fileName << ": " << gzerror(fp, &errorNumber) << "\n";
+                exit(EXIT_FAILURE);
+            }
+            if(readBytes == 0){endOfFile = true;}
+            block->size += readBytes;
+
+            current = block;
+            position = 0;
+        }
+
+        static constexpr size_t blockSize = 1 << 20;
+        std::shared_ptr<ReadBlockPool> pool = std::make_shared<ReadBlockPool>();
+        std::shared_ptr<ReadBlock> current;
+        size_t position = 0; // start of the next record in the current block
+        bool endOfFile = false;
+        unsigned long long records = 0; // parsed records (for error messages)
+
+        std::string fileName;
+        Format format = Format::fastq;
+        gzFile fp = Z_NULL;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+
+//a value sorted by a 64 bit integer key
+template<typename Value>
+struct radixRecord
+{
+    uint64_t key;
+    Value value;
+};
+
+/**
+ * @brief Stable LSD radix sort of records by their 64 bit key, one byte per pass.
+ * Passes for bytes that r the same in all keys r skipped (e.g. the upper bytes of pointers or small integers).
+ * Each pass runs in parallel: every thread counts the bytes of its part of the records, the counts r turned into the
+ * write positions of each thread, and every thread scatters its part (records of a thread keep their order, so the sort is stable).
+ *
+ * @param records the records to sort, sorted in place
+ * @param threads number of threads (small inputs r sorted with one thread)
+ */
+template<typename Value>
+void parallel_radix_sort(std::vector<radixRecord<Value>>& records, const int& threads)
+{
+    if(records.size() < 2){return;}
+
+    //bits that differ between the keys
+    uint64_t differentBits = 0;
+    for(const radixRecord<Value>& record : records)
+    {
+        differentBits |= (record.key ^ records.front().key);
+    }
+
+    const size_t minRecordsPerThread = 1 << 16;
+    const unsigned int usedThreads = std::max<size_t>(1, std::min<size_t>(threads < 1 ? 1 : threads, records.size() / minRecordsPerThread));
+    const size_t recordsPerThread = (records.size() + usedThreads - 1) / usedThreads;
+
+    std::vector<radixRecord<Value>> buffer(records.size());
+    std::vector<std::vector<size_t>> positions(usedThreads, std::vector<size_t>(256));
+    for(unsigned int shift = 0; shift < 64; shift += 8)
+    {
+        if(((differentBits >> shift) & 0xff) == 0){continue;}
+
+        //run func(thread, begin, end) for the part of the records of every thread
+        auto run_threads = [&](auto func)
+        {
+            std::vector<std::thread> workers;
+            for(unsigned int thread = 0; thread < usedThreads; ++thread)
+            {
+                const size_t begin = std::min(records.size(), thread * recordsPerThread);
+                const size_t end = std::min(records.size(), begin + recordsPerThread);
+                workers.emplace_back(func, thread, begin, end);
+            }
+            for(std::thread& worker : workers)
+            {
+                worker.join();
+            }
+        };
+
+        //count the bytes
+        run_threads([&](const unsigned int thread, const size_t begin, const size_t end)
+        {
+            std::vector<size_t>& count = positions[thread];
+            std::fill(count.begin(), count.end(), 0);
+            for(size_t i = begin; i < end; ++i)
+            {
+                ++count[(records[i].key >> shift) & 0xff];
+            }
+        });
+
+        //write positions: all records of a smaller byte first, within a byte the records of thread 0 first
+        size_t position = 0;
+        for(unsigned int byte = 0; byte < 256; ++byte)
+        {
+            for(unsigned int thread = 0; thread < usedThreads; ++thread)
+            {
+                const size_t count = positions[thread][byte];
+                positions[thread][byte] = position;
+                position += count;
+            }
+        }
+
+        //scatter the records
+        run_threads([&](const unsigned int thread, const size_t begin, const size_t end)
+        {
+            std::vector<size_t>& position = positions[thread];
+            for(size_t i = begin; i < end; ++i)
+            {
+                buffer[position[(records[i].key >> shift) & 0xff]++] = records[i];
+            }
+        });
+        records.swap(buffer);
+    }
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+/**
+ * @brief machine readable report of a run: wall and CPU time, reads and bytes of every stage, reads/s, the size of input and
+ * output files, peak RSS and the thread utilization (CPU time / (wall time * threads)). The report is written as JSON next to the output
+ * (RunReport_<output>.json), so that jobs can be sized by it and regressions between versions can be spotted.
+ * @details stages r timed from the main thread with start_stage/end_stage and accumulate if they run several times (e.g. for
+ * every partition of out of core processing), their CPU time is the CPU time of the whole process (all threads) during the stage.
+ * Parts that r interleaved with another stage (e.g. reading and decompression of reads within mapping) r timed with time_part,
+ * they only add the CPU time of the calling thread and r marked as overlapped.
+ * The memory of single data structures (bytes and objects) is recorded with record_memory, the report lists the high-water mark
+ * of every structure for every stage and over the whole run.
+ */
+class RunReport
+{
+    public:
+        RunReport(const std::string& tool = "", const int& threads = 1)
+        : tool(tool), threads(threads)
+        {
+            startWall = std::chrono::steady_clock::now();
+            startCpu = process_cpu_seconds();
+        }
+
+        void set_tool(const std::string& newTool, const int& newThreads)
+        {
+            tool = newTool;
+            threads = (newThreads < 1) ? 1 : newThreads;
+        }
+
+        void start_stage(const std::string& name)
+        {
+            stageTime& currentStage = stages.at(stage(name));
+            currentStage.startWall = std::chrono::steady_clock::now();
+            currentStage.startCpu = process_cpu_seconds();
+        }
+
+        void end_stage(const std::string& name, const unsigned long long& reads = 0, const unsigned long long& bytes = 0)
+        {
+            stageTime& currentStage = stages.at(stage(name));
+            currentStage.wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - currentStage.startWall).count();
+            currentStage.cpu += process_cpu_seconds() - currentStage.startCpu;
+            currentStage.reads += reads;
+            currentStage.bytes += bytes;
+            currentStage.peakRss = std::max(currentStage.peakRss, peak_rss());
+        }
+
+        //index of a stage (created if it does not exist yet), used to time a part without looking up its name
+        size_t stage(const std::string& name, const bool& overlapped = false)
+        {
+            for(size_t i = 0; i < stages.size(); ++i)
+            {
+                if(stages[i].name == name){return i;}
+            }
+            stageTime newStage;
+            newStage.name = name;
+            newStage.overlapped = overlapped;
+            stages.push_back(newStage);
+            return(stages.size() - 1);
+        }
+
+        //time a part of a stage (always from the same thread), returns the result of func
+        template<typename Func>
+        auto time_part(const size_t& stageIdx, Func func)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            const double cpuStart = thread_cpu_seconds();
+            auto result = func();
+            stageTime& currentStage = stages[stageIdx];
+            currentStage.wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            currentStage.cpu += thread_cpu_seconds() - cpuStart;
+            return result;
+        }
+
+        void add_counts(const std::string& name, const unsigned long long& reads, const unsigned long long& bytes = 0)
+        {
+            stageTime& currentStage = stages.at(stage(name));
+            currentStage.reads += reads;
+            currentStage.bytes += bytes;
+        }
+
+        //keep the high-water mark of the bytes (and the objects at that time) of a data structure in this stage and over the whole run
+        void record_memory(const std::string& stageName, const std::string& structure, const unsigned long long& bytes,
+                           const unsigned long long& objects)
+        {
+            update_memory(stages.at(stage(stageName)).memory[structure], bytes, objects);
+            update_memory(memoryHighWaterMarks[structure], bytes, objects);
+        }
+
+        //input and output files r only counted if they exist (e.g. no stats file without writeStats)
+        void add_input_file(const std::string& fileName)
+        {
+            add_file(fileName, inputFiles);
+        }
+        void add_output_file(const std::string& fileName)
+        {
+            add_file(fileName, outputFiles);
+        }
+
+        void set_total_reads(const unsigned long long& reads)
+        {
+            totalReads = reads;
+        }
+
+        //any other number of the run (e.g. hits of a cache)
+        void set_counter(const std::string& name, const double& value)
+        {
+            counters[name] = value;
+        }
+
+        //prepend a prefix to the file name of a path (same naming as for all other output files)
+        static std::string output_file(const std::string& output, const std::string& prefix)
+        {
+            std::size_t found = output.find_last_of("/");
+            if(found == std::string::npos)
+            {
+                return(prefix + output);
+            }
+            return(output.substr(0,found) + "/" + prefix + output.substr(found+1));
+        }
+
+        //writes the report to RunReport_<output>.json
+        void write(const std::string& output) const
+        {
+            const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - startWall).count();
+            const double cpu = process_cpu_seconds() - startCpu;
+            const std::string reportFile = output_file(output, "RunReport_") + ".json";
+            std::ofstream outputFile(reportFile);
+            if(!outputFile.is_open())
+            {
+                std::cerr << "ERROR: Could not open the run report file: " << reportFile << "\n";
+                exit(EXIT_FAILURE);
+            }
+
+            outputFile << "{\n";
+            outputFile << "  \"tool\": \"" << tool << "\",\n";
+            outputFile << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+            outputFile << "  \"threads\": " << threads << ",\n";
+            outputFile << "  \"wallSeconds\": " << wall << ",\n";
+            outputFile << "  \"cpuSeconds\": " << cpu << ",\n";
+            outputFile << "  \"reads\": " << totalReads << ",\n";
+            outputFile << "  \"readsPerSecond\": " << rate(totalReads, wall) << ",\n";
+            outputFile << "  \"inputBytes\": " << total_bytes(inputFiles) << ",\n";
+            outputFile << "  \"outputBytes\": " << total_bytes(outputFiles) << ",\n";
+            outputFile << "  \"peakRssBytes\": " << peak_rss() << ",\n";
+            outputFile << "  \"threadUtilization\": " << utilization(cpu, wall) << ",\n";
+            write_files(outputFile, "inputFiles", inputFiles);
+            write_files(outputFile, "outputFiles", outputFiles);
+            outputFile << "  \"counters\": {";
+            for(std::map<std::string, double>::const_iterator it = counters.begin(); it != counters.end(); ++it)
+            {
+                outputFile << (it == counters.begin() ? "" : ", ") << "\"" << it->first << "\": " << it->second;
+            }
+            outputFile << "},\n";
+            outputFile << "  \"memoryHighWaterMarks\": ";
+            write_memory(outputFile, memoryHighWaterMarks);
+            outputFile << ",\n";
+            outputFile << "  \"stages\": [\n";
+            for(size_t i = 0; i < stages.size(); ++i)
+            {
+                const stageTime& currentStage = stages[i];
+                outputFile << "    {\"name\": \"" << currentStage.name << "\", \"overlapped\": " << (currentStage.overlapped ? "true" : "false")
+                           << ", \"wallSeconds\": " << currentStage.wall << ", \"cpuSeconds\": " << currentStage.cpu
+                           << ", \"reads\": " << currentStage.reads << ", \"readsPerSecond\": " << rate(currentStage.reads, currentStage.wall)
+                           << ", \"bytes\": " << currentStage.bytes << ", \"peakRssBytes\": " << currentStage.peakRss;
+                //parts timed on one thread do not use the other threads
+                if(!currentStage.overlapped)
+                {
+                    outputFile << ", \"threadUtilization\": " << utilization(currentStage.cpu, currentStage.wall);
+                }
+                if(!currentStage.memory.empty())
+                {
+                    outputFile << ", \"memory\": ";
+                    write_memory(outputFile, currentStage.memory);
+                }
+                outputFile << "}" << ((i + 1 < stages.size()) ? ",\n" : "\n");
+            }
+            outputFile << "  ]\n";
+            outputFile << "}\n";
+            outputFile.close();
+        }
+
+    private:
+        struct structureMemory
+        {
+            unsigned long long bytes = 0;
+            unsigned long long objects = 0;
+        };
+
+        struct stageTime
+        {
+            std::string name;
+            bool overlapped = false;
+            double wall = 0;
+            double cpu = 0;
+            unsigned long long reads = 0;
+            unsigned long long bytes = 0;
+            unsigned long long peakRss = 0; // peak RSS of the process at the end of the stage
+            std::map<std::string, structureMemory> memory;
+
+            std::chrono::steady_clock::time_point startWall;
+            double startCpu = 0;
+        };
+
+        static double process_cpu_seconds()
+        {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            return(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+        }
+        static double thread_cpu_seconds()
+        {
+            struct timespec time;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+            return(time.tv_sec + time.tv_nsec / 1e9);
+        }
+        static unsigned long long peak_rss()
+        {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            return((unsigned long long)usage.ru_maxrss * 1024); // kilobytes on linux
+        }
+
+        double rate(const unsigned long long& reads, const double& seconds) const
+        {
+            return((seconds > 0) ? reads / seconds : 0);
+        }
+        double utilization(const double& cpu, const double& wall) const
+        {
+            return((wall > 0) ? cpu / (wall * threads) : 0);
+        }
+
+        void update_memory(structureMemory& memory, const unsigned long long& bytes, const unsigned long long& objects)
+        {
+            if(bytes < memory.bytes){return;}
+            memory.bytes = bytes;
+            memory.objects = objects;
+        }
+        void write_memory(std::ofstream& outputFile, const std::map<std::string, structureMemory>& memory) const
+        {
+            outputFile << "{";
+            for(std::map<std::string, structureMemory>::const_iterator it = memory.begin(); it != memory.end(); ++it)
+            {
+                outputFile << (it == memory.begin() ? "" : ", ") << "\"" << it->first << "\": {\"bytes\": " << it->second.bytes 
+                           << ", \"objects\": " << it->second.objects << "}";
+            }
+            outputFile << "}";
+        }
+
+        void add_file(const std::string& fileName, std::vector<std::pair<std::string, unsigned long long>>& files)
+        {
+            struct stat fileStat;
+            if(fileName.empty() || stat(fileName.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)){return;}
+            files.push_back(std::make_pair(fileName, (unsigned long long)fileStat.st_size));
+        }
+        unsigned long long total_bytes(const std::vector<std::pair<std::string, unsigned long long>>& files) const
+        {
+            unsigned long long bytes = 0;
+            for(const std::pair<std::string, unsigned long long>& file : files){bytes += file.second;}
+            return bytes;
+        }
+        void write_files(std::ofstream& outputFile, const std::string& key, const std::vector<std::pair<std::string, unsigned long long>>& files) const
+        {
+            outputFile << "  \"" << key << "\": {";
+            for(size_t i = 0; i < files.size(); ++i)
+            {
+                outputFile << "\"" << files[i].first << "\": " << files[i].second << ((i + 1 < files.size()) ? ", " : "");
+            }
+            outputFile << "},\n";
+        }
+
+        std::string tool;
+        int threads;
+        unsigned long long totalReads = 0;
+        std::chrono::steady_clock::time_point startWall;
+        double startCpu;
+
+        std::vector<stageTime> stages;
+        std::map<std::string, structureMemory> memoryHighWaterMarks;
+        std::map<std::string, double> counters;
+        std::vector<std::pair<std::string, unsigned long long>> inputFiles;
+        std::vector<std::pair<std::string, unsigned long long>> outputFiles;
+};
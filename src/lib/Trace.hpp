@@ -0,0 +1,205 @@
+#pragma once
+
+/**
+ * Timeline of the threads in the Chrome trace event format (open the Trace_<output>.json file in chrome://tracing or ui.perfetto.dev).
+ * Tracing is only compiled in with -DTRACE_EVENTS (e.g. make demultiplexingTrace), otherwise all TRACE_ macros expand to nothing
+ * (or to the plain lock) and cost nothing:
+ *
+ * TRACE_SPAN(category, name)                   span from here to the end of the scope
+ * TRACE_BATCH(batch, category, name, size)      spans of every size calls of TRACE_BATCH_NEXT(batch) (e.g. a batch of reads)
+ * TRACE_LOCK(mutex, name)                      mutex.lock(), a span is recorded only if the thread had to wait for the lock
+ * TRACE_LOCK_GUARD(guard, mutex, name)         std::lock_guard<std::mutex> guard(mutex), same as above
+ * TRACE_WRITE(output)                          writes the trace of all threads to Trace_<output>.json (call after all threads r done)
+ *
+ * Category and name must be string literals. Every thread records into its own buffer (no lock per event), a buffer stores at most
+ * maxEventsPerThread events, further events r dropped and counted.
+ */
+
+#ifdef TRACE_EVENTS
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unistd.h>
+
+class TraceRecorder
+{
+    public:
+        static TraceRecorder& instance()
+        {
+            static TraceRecorder recorder;
+            return recorder;
+        }
+
+        //microseconds since the start of the program
+        double now() const
+        {
+            return(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count());
+        }
+
+        void add(const char* category, const char* name, const double& start, const double& end)
+        {
+            threadBuffer& buffer = local();
+            if(buffer.events.size() >= maxEventsPerThread)
+            {
+                ++buffer.dropped;
+                return;
+            }
+            buffer.events.push_back(traceEvent{category, name, start, end - start});
+        }
+
+        void write(const std::string& output)
+        {
+            std::string traceFile = output;
+            std::size_t found = output.find_last_of("/");
+            if(found == std::string::npos)
+            {
+                traceFile = "Trace_" + output + ".json";
+            }
+            else
+            {
+                traceFile = output.substr(0,found) + "/" + "Trace_" + output.substr(found+1) + ".json";
+            }
+            std::ofstream outputFile(traceFile);
+            if(!outputFile.is_open())
+            {
+                std::cerr << "ERROR: Could not open the trace file: " << traceFile << "\n";
+                exit(EXIT_FAILURE);
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            const int pid = getpid();
+            unsigned long long dropped = 0;
+            outputFile << "{\"traceEvents\": [\n";
+            outputFile << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": 0, \"args\": {\"name\": \"" << output << "\"}}";
+            for(const std::unique_ptr<threadBuffer>& buffer : buffers)
+            {
+                //threads r numbered in the order of their first event
+                outputFile << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << buffer->tid
+                           << ", \"args\": {\"name\": \"thread " << buffer->tid << "\"}}";
+                for(const traceEvent& event : buffer->events)
+                {
+                    outputFile << ",\n{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"ts\": "
+                               << std::fixed << event.start << ", \"dur\": " << event.duration << std::defaultfloat
+                               << ", \"pid\": " << pid << ", \"tid\": " << buffer->tid << "}";
+                }
+                dropped += buffer->dropped;
+            }
+            outputFile << "\n],\n\"displayTimeUnit\": \"ms\",\n\"otherData\": {\"droppedEvents\": " << dropped << "}}\n";
+            outputFile.close();
+            if(dropped > 0)
+            {
+                std::cout << "WARNING: " << dropped << " trace events were dropped (more than " << maxEventsPerThread << " events for a thread)\n";
+            }
+        }
+
+    private:
+        TraceRecorder() : startTime(std::chrono::steady_clock::now()){}
+
+        struct traceEvent
+        {
+            const char* category;
+            const char* name;
+            double start;
+            double duration;
+        };
+        struct threadBuffer
+        {
+            int tid;
+            std::vector<traceEvent> events;
+            unsigned long long dropped = 0;
+        };
+
+        //the buffer of the calling thread, buffers r owned by the recorder so that they survive the threads of a pool
+        threadBuffer& local()
+        {
+            static thread_local threadBuffer* buffer = nullptr;
+            if(buffer == nullptr)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                buffers.emplace_back(std::make_unique<threadBuffer>());
+                buffer = buffers.back().get();
+                buffer->tid = buffers.size() - 1;
+            }
+            return(*buffer);
+        }
+
+        static const size_t maxEventsPerThread = 1 << 20;
+        std::chrono::steady_clock::time_point startTime;
+        std::mutex lock;
+        std::vector<std::unique_ptr<threadBuffer>> buffers;
+};
+
+//records a span from its construction to its destruction (or to end())
+class TraceSpan
+{
+    public:
+        TraceSpan(const char* category, const char* name) : category(category), name(name), start(TraceRecorder::instance().now()){}
+        ~TraceSpan()
+        {
+            end();
+        }
+        void end()
+        {
+            if(ended){return;}
+            ended = true;
+            TraceRecorder::instance().add(category, name, start, TraceRecorder::instance().now());
+        }
+
+    private:
+        const char* category;
+        const char* name;
+        double start;
+        bool ended = false;
+};
+
+//records one span for every size calls of next() (and one for the remaining calls when destroyed)
+class TraceBatch
+{
+    public:
+        TraceBatch(const char* category, const char* name, const unsigned long long& size)
+        : category(category), name(name), size(size), start(TraceRecorder::instance().now()){}
+        ~TraceBatch()
+        {
+            if(count > 0){TraceRecorder::instance().add(category, name, start, TraceRecorder::instance().now());}
+        }
+        void next()
+        {
+            if(++count < size){return;}
+            const double end = TraceRecorder::instance().now();
+            TraceRecorder::instance().add(category, name, start, end);
+            start = end;
+            count = 0;
+        }
+
+    private:
+        const char* category;
+        const char* name;
+        unsigned long long size;
+        double start;
+        unsigned long long count = 0;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SPAN(category, name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, name)
+#define TRACE_BATCH(batch, category, name, size) TraceBatch batch(category, name, size)
+#define TRACE_BATCH_NEXT(batch) batch.next()
+#define TRACE_LOCK(lockable, name) do{ if(!(lockable).try_lock()){ TraceSpan lockWait("lock", name); (lockable).lock(); } }while(0)
+#define TRACE_LOCK_GUARD(guard, lockable, name) TRACE_LOCK(lockable, name); std::lock_guard<std::mutex> guard(lockable, std::adopt_lock)
+#define TRACE_WRITE(output) TraceRecorder::instance().write(output)
+
+#else
+
+#define TRACE_SPAN(category, name)
+#define TRACE_BATCH(batch, category, name, size)
+#define TRACE_BATCH_NEXT(batch)
+#define TRACE_LOCK(lockable, name) (lockable).lock()
+#define TRACE_LOCK_GUARD(guard, lockable, name) std::lock_guard<std::mutex> guard(lockable)
+#define TRACE_WRITE(output)
+
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "Trace.hpp"
+
+/**
+ * @brief Runs many tasks of very different costs (e.g. one task per UMI or per AB-SC group) on a fixed number of threads.
+ * Tasks r ordered by their estimated cost (most expensive first) and small tasks r batched into chunks of similar cost,
+ * like that we do not pay the dispatch overhead for millions of tiny tasks and the giant tasks do not start last.
+ * The chunks r distributed over one queue per thread, a thread with an empty queue steals chunks from the other queues
+ * (from the end with the cheapest chunks), so all threads stay busy until the end.
+ * The threads r started once and wait for the next run, so an executor can be reused for many small runs
+ * (e.g. one run per giant group); the calling thread works as one of the threads.
+ */
+class WorkStealingExecutor
+{
+    public:
+        WorkStealingExecutor(const int& threads, const unsigned int& chunksPerThread = 16)
+        : threads(threads < 1 ? 1 : threads), chunksPerThread(chunksPerThread), queues(this->threads)
+        {
+            for(unsigned int id = 1; id < this->threads; ++id)
+            {
+                workers.emplace_back(&WorkStealingExecutor::worker_loop, this, id);
+            }
+        }
+        ~WorkStealingExecutor()
+        {
+            {
+                std::lock_guard<std::mutex> guard(jobLock);
+                stopping = true;
+            }
+            jobSignal.notify_all();
+            for(std::thread& worker : workers)
+            {
+                worker.join();
+            }
+        }
+        WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+        WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+        /** @brief run func(task) for all tasks in [0, tasks)
+         * @param cost estimated cost of a task, cost(task)
+         */
+        template<typename Func, typename Cost>
+        void run(const size_t& tasks, Func func, Cost cost)
+        {
+            if(tasks == 0){return;}
+
+            //order tasks by decreasing cost
+            std::vector<std::pair<unsigned long long, size_t>> order(tasks);
+            unsigned long long totalCost = 0;
+            for(size_t task = 0; task < tasks; ++task)
+            {
+                order[task] = std::make_pair(cost(task) + 1, task); //every task costs at least one
+                totalCost += order[task].first;
+            }
+            std::sort(order.begin(), order.end(), std::greater<std::pair<unsigned long long, size_t>>());
+
+            //batch tasks into chunks, expensive tasks stay alone in their chunk
+            const unsigned long long chunkCost = std::max(1ULL, totalCost / (threads * chunksPerThread));
+            std::vector<std::pair<size_t, size_t>> chunks; //[begin, end) in order
+            size_t chunkBegin = 0;
+            unsigned long long currentCost = 0;
+            for(size_t i = 0; i < tasks; ++i)
+            {
+                currentCost += order[i].first;
+                if(currentCost >= chunkCost)
+                {
+                    chunks.emplace_back(chunkBegin, i + 1);
+                    chunkBegin = i + 1;
+                    currentCost = 0;
+                }
+            }
+            if(chunkBegin < tasks){chunks.emplace_back(chunkBegin, tasks);}
+
+            //chunks r dealt round robin, every queue starts with its most expensive chunk
+            for(size_t chunk = 0; chunk < chunks.size(); ++chunk)
+            {
+                queues[chunk % threads].chunks.push_back(chunk);
+            }
+
+            std::function<void(const unsigned int&)> job = [&](const unsigned int& id)
+            {
+                size_t chunk;
+                while(next_chunk(id, chunk))
+                {
+                    TRACE_SPAN("task", "task chunk");
+                    for(size_t i = chunks[chunk].first; i < chunks[chunk].second; ++i)
+                    {
+                        func(order[i].second);
+                    }
+                }
+            };
+
+            //wake up the waiting threads and work on the chunks as thread 0 until all threads r done
+            {
+                std::lock_guard<std::mutex> guard(jobLock);
+                currentJob = &job;
+                ++jobNumber;
+                busyWorkers = workers.size();
+            }
+            jobSignal.notify_all();
+            job(0);
+            std::unique_lock<std::mutex> guard(jobLock);
+            doneSignal.wait(guard, [this]{return busyWorkers == 0;});
+            currentJob = nullptr;
+        }
+
+    private:
+        struct workQueue
+        {
+            std::mutex lock;
+            std::deque<size_t> chunks;
+        };
+
+        //threads 1..threads-1 wait for the next job and run it once
+        void worker_loop(const unsigned int id)
+        {
+            unsigned long long doneJobs = 0;
+            std::unique_lock<std::mutex> guard(jobLock);
+            while(true)
+            {
+                jobSignal.wait(guard, [&]{return stopping || jobNumber != doneJobs;});
+                if(stopping){return;}
+                doneJobs = jobNumber;
+                const std::function<void(const unsigned int&)>* job = currentJob;
+                guard.unlock();
+                (*job)(id);
+                guard.lock();
+                if(--busyWorkers == 0){doneSignal.notify_all();}
+            }
+        }
+
+        //take the next chunk of the own queue, or steal one of another queue; no chunks r added while running,
+        //so if all queues r empty we r done
+        bool next_chunk(const unsigned int& id, size_t& chunk)
+        {
+            {
+                TRACE_LOCK_GUARD(guard, queues[id].lock, "work queue");
+                if(!queues[id].chunks.empty())
+                {
+                    chunk = queues[id].chunks.front();
+                    queues[id].chunks.pop_front();
+                    return true;
+                }
+            }
+            for(unsigned int i = 1; i < threads; ++i)
+            {
+                workQueue& victim = queues[(id + i) % threads];
+                TRACE_LOCK_GUARD(guard, victim.lock, "work queue");
+                if(!victim.chunks.empty())
+                {
+                    chunk = victim.chunks.back();
+                    victim.chunks.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        unsigned int threads;
+        unsigned int chunksPerThread;
+        std::vector<workQueue> queues;
+
+        //the running job, jobNumber counts the runs so that every thread runs a job only once
+        std::vector<std::thread> workers;
+        std::mutex jobLock;
+        std::condition_variable jobSignal;
+        std::condition_variable doneSignal;
+        const std::function<void(const unsigned int&)>* currentJob = nullptr;
+        unsigned long long jobNumber = 0;
+        size_t busyWorkers = 0;
+        bool stopping = false;
+};
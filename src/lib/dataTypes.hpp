@@ -5,6 +5,14 @@
 #include <string>
 #include <string.h>
 #include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "Trace.hpp"
 
 class CharHash
 {
@@ -21,65 +29,253 @@ struct CharPtrComparator {
    }
 };
 
+//bytes and number of objects (e.g. strings, reads, dict entries) of a data structure, reported in the run report
+struct memoryUsage
+{
+    unsigned long long bytes = 0;
+    unsigned long long objects = 0;
+
+    memoryUsage& operator+=(const memoryUsage& other)
+    {
+        bytes += other.bytes;
+        objects += other.objects;
+        return *this;
+    }
+};
+
+//estimated bytes of a std::unordered_map/set without the memory its values own: the bucket array and one node per element
+//(value, pointer to the next node and the cached hash)
+template<typename HashTable>
+inline unsigned long long hash_table_bytes(const HashTable& table)
+{
+    return(table.bucket_count() * sizeof(void*) + table.size() * (sizeof(typename HashTable::value_type) + 2 * sizeof(void*)));
+}
+template<typename T>
+inline unsigned long long vector_bytes(const std::vector<T>& vector)
+{
+    return(vector.capacity() * sizeof(T));
+}
+
+//compact handle of a string in the UniqueCharSet: the upper bits store the stripe, the lower bits
+//the index of the string within this stripe. Handles use only 31 bits, the highest bit is free for users to tag their values
+typedef uint32_t charHandle;
+
+/**
+ * @brief A thread safe set of unique strings. Every string is stored only once and is identified by a
+ * charHandle or a const char* that stays valid (and unique) for the lifetime of the set, therefore
+ * pointers of the same string can be compared directly.
+ * The set is split into stripes with their own lock (the stripe is chosen by the hash of the string), so threads
+ * inserting strings only wait for each other if they hit the same stripe. Strings r copied into large blocks of memory
+ * and each entry of the hash table stores the hash and length of its string, by that growing the table never
+ * recomputes a hash and lookups compare strings only if hash and length match.
+ */
 class UniqueCharSet
 {
 
    public:
 
-      ~UniqueCharSet()
+      UniqueCharSet() : stripes(new Stripe[stripeCount]) {}
+      UniqueCharSet(const UniqueCharSet&) = delete;
+      UniqueCharSet& operator=(const UniqueCharSet&) = delete;
+
+      void printSet() 
       {
-         clearUniqueSet();
+         for(size_t stripe = 0; stripe < stripeCount; ++stripe)
+         {
+            std::lock_guard<std::mutex> guard(stripes[stripe].lock);
+            for(size_t i = 0; i < stripes[stripe].stringCount; ++i)
+            {
+               std::cout << stripes[stripe].get_string(i) << "\n";
+            }
+         }
       }
 
-      void printSet() 
+      //returns the handle of the string, the string is inserted if we have not seen it yet
+      charHandle getHandle(const std::string_view& k)
       {
-         for(auto it = charPtrSet.begin(); it != charPtrSet.end(); ++it)
-            std::cout << *it << "\n";
+         const size_t hash = std::hash<std::string_view>()(k);
+         const charHandle stripeIdx = hash & (stripeCount - 1);
+         Stripe& stripe = stripes[stripeIdx];
+
+         TRACE_LOCK_GUARD(guard, stripe.lock, "UniqueCharSet stripe");
+         return( (stripeIdx << localBits) | stripe.find_or_insert(k, hash) );
+      }
+
+      //returns the unique string for a handle (no lock needed, strings r never moved once inserted)
+      inline const char* getChar(const charHandle& handle) const
+      {
+         return(stripes[handle >> localBits].get_string(handle & localMask));
       }
 
       const char* getUniqueChar(const char* k)
       {
-         std::unordered_set<const char*, CharHash, CharPtrComparator>::iterator idx = charPtrSet.find(k);
-         if(idx != charPtrSet.end())
-         {
-            return *idx;
+         if(!k) {
+            exit(EXIT_FAILURE);
          }
-         else
+         return(getChar(getHandle(std::string_view(k, strlen(k)))));
+      }
+
+      size_t size()
+      {
+         size_t count = 0;
+         for(size_t stripe = 0; stripe < stripeCount; ++stripe)
          {
-            const char* x = insertElement(k);
-            return(x);
+            std::lock_guard<std::mutex> guard(stripes[stripe].lock);
+            count += stripes[stripe].stringCount;
          }
+         return(count);
       }
 
-      void clearUniqueSet() 
+      //bytes of the hash tables, string directories and string blocks, objects r the unique strings
+      memoryUsage memory_usage()
       {
-         for(auto it = charPtrSet.begin(); it != charPtrSet.end(); ++it) 
+         memoryUsage usage;
+         usage.bytes = sizeof(UniqueCharSet) + stripeCount * sizeof(Stripe);
+         for(size_t stripeIdx = 0; stripeIdx < stripeCount; ++stripeIdx)
          {
-            const char* key = *it;
-
-            if(key) {
-               delete [] key;
-               key = nullptr;
+            Stripe& stripe = stripes[stripeIdx];
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            const size_t directoryChunks = (stripe.stringCount + stringChunkSize - 1) >> stringChunkBits;
+            usage.bytes += vector_bytes(stripe.table) + stringDirectorySize * sizeof(std::unique_ptr<const char*[]>) 
+                           + directoryChunks * stringChunkSize * sizeof(const char*)
+                           + vector_bytes(stripe.blocks) + stripe.blocks.size() * stringBlockSize + vector_bytes(stripe.longStrings);
+            for(const std::unique_ptr<char[]>& longString : stripe.longStrings)
+            {
+               usage.bytes += strlen(longString.get()) + 1;
             }
+            usage.objects += stripe.stringCount;
          }
-         charPtrSet.clear();
+         return(usage);
       }
 
    private:
 
-      const char* insertElement(const char* k) 
+      static const unsigned int stripeBits = 6;
+      static const size_t stripeCount = (size_t(1) << stripeBits);
+      static const unsigned int localBits = 31 - stripeBits;
+      static const charHandle localMask = (charHandle(1) << localBits) - 1;
+
+      //strings of a stripe r addressed through a directory of fixed size, so the directory is never moved
+      //while other threads look up strings
+      static const unsigned int stringChunkBits = 16;
+      static const size_t stringChunkSize = (size_t(1) << stringChunkBits);
+      static const size_t stringDirectorySize = (size_t(1) << (localBits - stringChunkBits));
+      //strings r copied into blocks of this size (longer strings get their own block)
+      static const size_t stringBlockSize = 64 * 1024;
+
+      struct Entry
       {
-         if(!k) {
-            exit(EXIT_FAILURE);
+         size_t hash;
+         uint32_t length;
+         charHandle localIdx;
+      };
+      static const charHandle emptyEntry = std::numeric_limits<charHandle>::max();
+
+      struct Stripe
+      {
+         std::mutex lock;
+
+         //open addressing hash table with linear probing
+         std::vector<Entry> table = std::vector<Entry>(64, Entry{0, 0, emptyEntry});
+
+         //local index => string
+         std::unique_ptr<std::unique_ptr<const char*[]>[]> stringDirectory = 
+            std::unique_ptr<std::unique_ptr<const char*[]>[]>(new std::unique_ptr<const char*[]>[stringDirectorySize]);
+         size_t stringCount = 0;
+
+         //memory for the strings
+         std::vector<std::unique_ptr<char[]>> blocks;
+         std::vector<std::unique_ptr<char[]>> longStrings;
+         size_t blockPos = stringBlockSize;
+
+         inline const char* get_string(const size_t& localIdx) const
+         {
+            return(stringDirectory[localIdx >> stringChunkBits][localIdx & (stringChunkSize - 1)]);
          }
-         char* key = new char[strlen(k) + 1];
-         strcpy(key, k);
-         charPtrSet.insert(key);
 
-         return(key);
-      }
+         charHandle find_or_insert(const std::string_view& k, const size_t& hash)
+         {
+            size_t mask = table.size() - 1;
+            //lower bits of the hash r the stripe, use the upper ones for the table
+            size_t pos = (hash >> stripeBits) & mask;
+            while(table[pos].localIdx != emptyEntry)
+            {
+               const Entry& entry = table[pos];
+               if(entry.hash == hash && entry.length == k.size() && 
+                  memcmp(get_string(entry.localIdx), k.data(), k.size()) == 0)
+               {
+                  return(entry.localIdx);
+               }
+               pos = (pos + 1) & mask;
+            }
+
+            //insert a new string
+            if(stringCount > localMask)
+            {
+               std::cerr << "ERROR: Too many unique strings to store in the UniqueCharSet\n";
+               exit(EXIT_FAILURE);
+            }
+            charHandle localIdx = stringCount;
+            if((localIdx & (stringChunkSize - 1)) == 0)
+            {
+               stringDirectory[localIdx >> stringChunkBits].reset(new const char*[stringChunkSize]);
+            }
+            stringDirectory[localIdx >> stringChunkBits][localIdx & (stringChunkSize - 1)] = copy_string(k);
+            ++stringCount;
+            table[pos] = Entry{hash, uint32_t(k.size()), localIdx};
+
+            //keep load factor below 0.7
+            if(stringCount * 10 > table.size() * 7)
+            {
+               grow_table();
+            }
+            return(localIdx);
+         }
+
+         const char* copy_string(const std::string_view& k)
+         {
+            const size_t length = k.size() + 1;
+            char* key;
+            if(length > stringBlockSize / 4)
+            {
+               //long strings r stored in their own block
+               longStrings.emplace_back(new char[length]);
+               key = longStrings.back().get();
+            }
+            else
+            {
+               if(blockPos + length > stringBlockSize)
+               {
+                  blocks.emplace_back(new char[stringBlockSize]);
+                  blockPos = 0;
+               }
+               key = blocks.back().get() + blockPos;
+               blockPos += length;
+            }
+            memcpy(key, k.data(), k.size());
+            key[k.size()] = '\0';
+            return(key);
+         }
+
+         void grow_table()
+         {
+            std::vector<Entry> newTable(table.size() * 2, Entry{0, 0, emptyEntry});
+            size_t mask = newTable.size() - 1;
+            for(const Entry& entry : table)
+            {
+               if(entry.localIdx == emptyEntry){continue;}
+               size_t pos = (entry.hash >> stripeBits) & mask;
+               while(newTable[pos].localIdx != emptyEntry)
+               {
+                  pos = (pos + 1) & mask;
+               }
+               newTable[pos] = entry;
+            }
+            table.swap(newTable);
+         }
+      };
 
-      std::unordered_set<const char*, CharHash, CharPtrComparator> charPtrSet;
+      std::unique_ptr<Stripe[]> stripes;
 };
 
 struct UnorderedSetComparator
@@ -8,6 +8,168 @@
 #include <string_view>
 #include <cstring>
 #include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+//small id of the calling thread, the ids of finished threads r reused so that the ids stay dense
+inline size_t dense_thread_id()
+{
+    struct threadIdPool
+    {
+        std::mutex lock;
+        std::vector<size_t> freeIds;
+        size_t nextId = 0;
+    };
+    static threadIdPool pool;
+
+    //takes an id when the thread first asks for it and gives it back when the thread ends
+    struct threadId
+    {
+        size_t id;
+        threadId()
+        {
+            std::lock_guard<std::mutex> guard(pool.lock);
+            if(pool.freeIds.empty())
+            {
+                id = pool.nextId++;
+            }
+            else
+            {
+                id = pool.freeIds.back();
+                pool.freeIds.pop_back();
+            }
+        }
+        ~threadId()
+        {
+            std::lock_guard<std::mutex> guard(pool.lock);
+            pool.freeIds.push_back(id);
+        }
+    };
+    static thread_local threadId thread;
+    return(thread.id);
+}
+
+/**
+ * @brief One instance of T for every thread using this object, threads can therefore collect their results without any lock.
+ * Every object has a slot per dense thread id, the lock is only taken the first time a thread asks for its instance.
+ * A thread that reuses the id of a finished thread continues with the instance of that thread.
+ * The instances can be iterated in the order the threads first used this object.
+ */
+template<typename T>
+class ThreadLocalShards
+{
+    public:
+        ThreadLocalShards() : table(std::make_unique<shardTable>()){}
+
+        //returns the instance of the calling thread
+        T& local()
+        {
+            //slots r stored in buckets of 1,2,4,... slots, so buckets never move once a thread holds them
+            const unsigned long long slot = dense_thread_id() + 1;
+            const int bucket = 63 - __builtin_clzll(slot);
+            const unsigned long long bucketSlot = slot - (1ULL << bucket);
+
+            std::atomic<T*>* slots = table->buckets[bucket].load(std::memory_order_acquire);
+            if(slots != nullptr)
+            {
+                T* shard = slots[bucketSlot].load(std::memory_order_relaxed);
+                if(shard != nullptr)
+                {
+                    return(*shard);
+                }
+            }
+            return(new_shard(bucket, bucketSlot));
+        }
+
+        //call func for the instances of all threads, may run while threads still write to their instance
+        //(e.g. for the progress report): func may then only read members that r atomics (relaxed loads)
+        template<typename Func>
+        void for_each(Func func) const
+        {
+            std::lock_guard<std::mutex> guard(table->lock);
+            for(const std::unique_ptr<T>& shard : table->shards)
+            {
+                func(*shard);
+            }
+        }
+        template<typename Func>
+        void for_each(Func func)
+        {
+            std::lock_guard<std::mutex> guard(table->lock);
+            for(std::unique_ptr<T>& shard : table->shards)
+            {
+                func(*shard);
+            }
+        }
+
+    private:
+        T& new_shard(const int& bucket, const unsigned long long& bucketSlot)
+        {
+            std::lock_guard<std::mutex> guard(table->lock);
+            std::atomic<T*>* slots = table->buckets[bucket].load(std::memory_order_relaxed);
+            if(slots == nullptr)
+            {
+                table->bucketMemory.emplace_back(std::make_unique<std::atomic<T*>[]>(1ULL << bucket)); //value initialized to nullptr
+                slots = table->bucketMemory.back().get();
+                table->buckets[bucket].store(slots, std::memory_order_release);
+            }
+            table->shards.emplace_back(std::make_unique<T>());
+            slots[bucketSlot].store(table->shards.back().get(), std::memory_order_relaxed);
+            return(*table->shards.back());
+        }
+
+        //the slots and instances belong to the object and r freed with it, no thread keeps pointers into it
+        struct shardTable
+        {
+            std::mutex lock;
+            std::vector<std::unique_ptr<T>> shards;
+            std::atomic<std::atomic<T*>*> buckets[64] = {};
+            std::vector<std::unique_ptr<std::atomic<T*>[]>> bucketMemory;
+        };
+        std::unique_ptr<shardTable> table;
+};
+
+//add to a counter that is only written by the calling thread (no atomic read-modify-write needed, 
+//the counter is atomic only so that other threads can read it while it is written)
+inline void add_to_counter(std::atomic<unsigned long long>& counter, const long long& value = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief counter that many threads can increment without contention: every thread adds to its own counter
+ * (on its own cache line), total() sums them up.
+ */
+class ThreadCounter
+{
+    public:
+        inline void add(const long long& value = 1)
+        {
+            add_to_counter(counters.local().value, value);
+        }
+        unsigned long long total() const
+        {
+            unsigned long long sum = 0;
+            counters.for_each([&](const paddedCounter& counter){sum += counter.value.load(std::memory_order_relaxed);});
+            return sum;
+        }
+
+    private:
+        struct alignas(64) paddedCounter
+        {
+            std::atomic<unsigned long long> value = 0;
+        };
+        ThreadLocalShards<paddedCounter> counters;
+};
 
 #define PBSTR "||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||"
 #define PBWIDTH 60
@@ -87,6 +249,100 @@ inline void printProgress(double percentage) {
     std::cout << "\t\r[" << std::string(loadLength, '|') << std::string(emptyLength, ' ') << "] " << val << "%" << std::flush;
 }
 
+/**
+ * @brief prints the progress of a step from its own thread: every interval the processed reads (and bytes) r sampled
+ * and printed as progress bar with reads/s, MB/s and the estimated time left. Worker threads only count their reads
+ * (e.g. in a ThreadCounter) and never write to stdout themselves.
+ * @param readsDone returns the reads processed so far
+ * @param totalReads number of reads to process, ULLONG_MAX if unknown (no progress bar and ETA)
+ * @param bytesDone returns the processed bytes (optional)
+ */
+class ProgressReporter
+{
+    public:
+        ProgressReporter(std::function<unsigned long long()> readsDone, const unsigned long long& totalReads,
+                         std::function<unsigned long long()> bytesDone = nullptr, 
+                         const std::chrono::milliseconds& interval = std::chrono::milliseconds(500))
+        : readsDone(readsDone), bytesDone(bytesDone), totalReads(totalReads), interval(interval)
+        {
+            startTime = std::chrono::steady_clock::now();
+            reporter = std::thread(&ProgressReporter::report_loop, this);
+        }
+        ~ProgressReporter()
+        {
+            stop();
+        }
+
+        //stop reporting and print the final progress
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if(stopped){return;}
+                stopped = true;
+            }
+            stopSignal.notify_all();
+            reporter.join();
+            print(true);
+            std::cout << "\n";
+        }
+
+    private:
+        void report_loop()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopSignal.wait_for(guard, interval, [this]{return stopped;}))
+            {
+                print(false);
+            }
+        }
+
+        void print(const bool& finished)
+        {
+            const unsigned long long reads = readsDone();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            const double readsPerSecond = (seconds > 0) ? reads / seconds : 0;
+
+            std::string rates = " | " + std::to_string((unsigned long long)readsPerSecond) + " reads/s";
+            if(bytesDone)
+            {
+                const double megaBytesPerSecond = (seconds > 0) ? bytesDone() / (seconds * 1000000) : 0;
+                rates += " | " + std::to_string((unsigned long long)megaBytesPerSecond) + " MB/s";
+            }
+
+            if(totalReads == ULLONG_MAX || totalReads == 0)
+            {
+                std::cout << "\t\r" << reads << " reads" << rates << std::flush;
+                return;
+            }
+
+            double percentage = finished ? 1 : MIN(reads / (double)totalReads, 1.0);
+            if(!finished && readsPerSecond > 0 && reads < totalReads)
+            {
+                unsigned long long secondsLeft = (totalReads - reads) / readsPerSecond;
+                char eta[32];
+                snprintf(eta, sizeof(eta), " | ETA %02llu:%02llu:%02llu", secondsLeft / 3600, (secondsLeft / 60) % 60, secondsLeft % 60);
+                rates += eta;
+            }
+            int val = (int) (percentage*100);
+            int loadLength = (int) (percentage * PBWIDTH);
+            int emptyLength = PBWIDTH - loadLength;
+            std::cout << "\t\r[" << std::string(loadLength, '|') << std::string(emptyLength, ' ') << "] " << val << "%" << rates 
+                      << "        " << std::flush;
+        }
+
+        std::function<unsigned long long()> readsDone;
+        std::function<unsigned long long()> bytesDone;
+        unsigned long long totalReads;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point startTime;
+
+        std::mutex lock;
+        std::condition_variable stopSignal;
+        bool stopped = false;
+        std::thread reporter;
+};
+
 //stores all the input parameters for the mapping tools
 struct input{
     std::string inFile;
@@ -106,19 +362,103 @@ struct input{
     bool writeFailedLines = false;
     long long int fastqReadBucketSize = 10000000;
     int threads = 5;
+    unsigned long long mappingCacheSize = 0; //number of reads whose mapping outcome is cached (0 disables the cache)
+    bool collapseOutput = false; //write identical demultiplexed reads only once with their number of reads in a COUNT column
 };
 
-struct fastqStats{
+//counters of one thread during mapping, on their own cache line (use add_to_counter to increment them)
+struct alignas(64) mappingCounters
+{
     //parameters that are evaluated over the whole fastq line
     //e.g. perfect match occurs only if ALL barcodes match perfectly in a fastq line
     std::atomic<unsigned long long> perfectMatches = 0;
     std::atomic<unsigned long long> noMatches = 0;
     std::atomic<unsigned long long> moderateMatches = 0;
+    //processed reads and bases of the reads (for the progress report)
+    std::atomic<unsigned long long> reads = 0;
+    std::atomic<unsigned long long> bytes = 0;
+    //lookups of the mapping cache
+    std::atomic<unsigned long long> cacheHits = 0;
+    std::atomic<unsigned long long> cacheMisses = 0;
+};
+
+struct fastqStats{
+    //every thread counts in its own mappingCounters, sum them up with total
+    ThreadLocalShards<mappingCounters> counters;
+    inline mappingCounters& local()
+    {
+        return counters.local();
+    }
+    unsigned long long total(std::atomic<unsigned long long> mappingCounters::* counter) const
+    {
+        unsigned long long sum = 0;
+        counters.for_each([&](const mappingCounters& threadCounters){sum += (threadCounters.*counter).load(std::memory_order_relaxed);});
+        return sum;
+    }
+
     //parameter stating how often a barcode sequence could be matched to several sequences, can occure more than once per line
     //can only happen for vairable sequences
     //a dictionary of the number of mismatches in a barcode, in the case of a match
+    //(only filled from the histograms of the threads by merge_mismatch_histograms)
     std::map<std::string, std::vector<int> > mapping_dict;
-    std::unique_ptr<std::mutex> statsLock;
+
+    //during mapping every thread counts mismatches in its own histogram: one row of 'mismatches + 2' counts for every barcode,
+    //the mapping knows the row of a matched barcode (Barcode::statsRows), barcodeIdx is only used to add the barcodes before mapping
+    std::unordered_map<std::string, unsigned int> barcodeIdx;
+    std::vector<std::string> barcodeOfIdx;
+    std::vector<size_t> histogramRowStart; //one entry more than barcodes, the last one is the size of the histogram
+    ThreadLocalShards<std::vector<int>> mismatchHistograms;
+
+    //add a barcode to the statistics and return its row, if it already exists the first one is kept
+    unsigned int add_barcode(const std::string& barcode, const int& mismatches)
+    {
+        std::unordered_map<std::string, unsigned int>::const_iterator barcodeIt = barcodeIdx.find(barcode);
+        if(barcodeIt != barcodeIdx.end()){return barcodeIt->second;}
+        if(histogramRowStart.empty()){histogramRowStart.push_back(0);}
+
+        const unsigned int row = barcodeOfIdx.size();
+        barcodeIdx.insert(std::make_pair(barcode, row));
+        barcodeOfIdx.push_back(barcode);
+        histogramRowStart.push_back(histogramRowStart.back() + mismatches + 2);
+        mapping_dict.insert(std::make_pair(barcode, std::vector<int>(mismatches + 2, 0)));
+        return row;
+    }
+
+    //count a mapped barcode (its row returned by add_barcode) in the histogram of this thread
+    inline void add_mismatch(const int& barcodeRow, const int& dictvectorIndex)
+    {
+        //only barcodes added before mapping r counted (e.g. not the guide barcodes)
+        if(barcodeRow < 0){return;}
+
+        std::vector<int>& histogram = mismatchHistograms.local();
+        if(histogram.empty())
+        {
+            histogram.resize(histogramRowStart.back(), 0);
+        }
+        const size_t rowStart = histogramRowStart[barcodeRow];
+        if(rowStart + dictvectorIndex < histogramRowStart[barcodeRow + 1])
+        {
+            ++histogram[rowStart + dictvectorIndex];
+        }
+    }
+
+    //add the histograms of all threads into mapping_dict (after mapping is done)
+    void merge_mismatch_histograms()
+    {
+        mismatchHistograms.for_each([&](std::vector<int>& histogram)
+        {
+            if(histogram.empty()){return;}
+            for(size_t barcode = 0; barcode < barcodeOfIdx.size(); ++barcode)
+            {
+                std::vector<int>& counts = mapping_dict.at(barcodeOfIdx[barcode]);
+                for(size_t i = 0; i < counts.size(); ++i)
+                {
+                    counts[i] += histogram[histogramRowStart[barcode] + i];
+                }
+            }
+            std::fill(histogram.begin(), histogram.end(), 0);
+        });
+    }
 };
 
 struct levenshtein_value{
@@ -137,6 +477,8 @@ inline levenshtein_value min(levenshtein_value a, levenshtein_value b)
     return b;
 }
 
+//the furthest reaching rows on all diagonals for the current and previous number of mismatches
+//kept thread local, so calculating a distance allocates nothing once the buffers r large enough
 struct frontMatrix
 {
     std::vector<unsigned int> previous;
@@ -144,54 +486,74 @@ struct frontMatrix
     unsigned int offset;
     unsigned int d;
 
-    frontMatrix(unsigned int m, unsigned int n): previous(m+n+3, UINT_MAX), current(m+n+3, UINT_MAX){}
+    void reset(unsigned int m, unsigned int n)
+    {
+        previous.assign(m+n+3, UINT_MAX);
+        current.assign(m+n+3, UINT_MAX);
+    }
 };
-//calculate longest common prefix of two sequences
-inline int lcp(const std::string& a, const std::string& b)
+//calculate longest common prefix of two sequences of which we compare at most len bases (8 bases at a time)
+inline unsigned int lcp(const char* a, const char* b, const unsigned int& len)
 {
     unsigned int lcp = 0;
-    unsigned int a_len = a.length();
-    unsigned int b_len = b.length();
-    unsigned int len = (a_len > b_len) ? b_len : a_len;
-
-    while( (a[lcp] == b[lcp]) && (lcp < len) )
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    while(lcp + 8 <= len)
+    {
+        uint64_t aWord, bWord;
+        memcpy(&aWord, a + lcp, 8);
+        memcpy(&bWord, b + lcp, 8);
+        const uint64_t diff = aWord ^ bWord;
+        if(diff != 0)
+        {
+            return(lcp + (__builtin_ctzll(diff) >> 3));
+        }
+        lcp += 8;
+    }
+#endif
+    while( (lcp < len) && (a[lcp] == b[lcp]) )
     {
         ++lcp;
     }
     return lcp;
 }
+inline int lcp(const std::string& a, const std::string& b)
+{
+    return lcp(a.data(), b.data(), MIN(a.length(), b.length()));
+}
 //calculates the next front
 //idea: how far along all the diagonals that r within x-mismatches can i go in my edit-matrix with x-mismatches
-inline void front(const std::string& a, const std::string& b, frontMatrix& f)
+inline void front(const char* a, const unsigned int& aLength, const char* b, const unsigned int& bLength, frontMatrix& f)
 {
-    unsigned int min = MIN(a.length(), f.d);
-    unsigned int max = MIN(b.length(), f.d);
+    unsigned int min = MIN(aLength, f.d);
+    unsigned int max = MIN(bLength, f.d);
 
-    f.previous = f.current;
+    //the diagonals of the last front become the previous ones, diagonals outside of [offset-min, offset+max] were never set
+    //and r UINT_MAX in both vectors
+    std::swap(f.previous, f.current);
 
     unsigned int l = 0;
     for(unsigned int i = (f.offset-min); i <= (f.offset + max); ++i)
     {
         unsigned int aVal = 0, bVal = 0, cVal = 0;
-        if(f.previous.at(i-1) != UINT_MAX){ aVal = f.previous.at(i-1);}
-        if(f.previous.at(i+1) != UINT_MAX){ bVal = f.previous.at(i+1)+1;}
-        if(f.previous.at(i) != UINT_MAX){ cVal = f.previous.at(i)+1;}
+        if(f.previous[i-1] != UINT_MAX){ aVal = f.previous[i-1];}
+        if(f.previous[i+1] != UINT_MAX){ bVal = f.previous[i+1]+1;}
+        if(f.previous[i] != UINT_MAX){ cVal = f.previous[i]+1;}
 
         l = MAX(MAX(aVal, bVal), cVal);
             
-            if(l >= a.length())
+            if(l >= aLength)
             {
-                f.current.at(i) = a.length();
+                f.current[i] = aLength;
             }
-            else if( (i - f.offset + l) >= b.length())
+            else if( (i - f.offset + l) >= bLength)
             {
-                //in this case the row must be i, however it already is at this point...
-                //to set explicitely uncomment
-                //f.current.at(i) = i;
+                //in this case the row must be i, the diagonal keeps its value of the last front
+                f.current[i] = f.previous[i];
             }
             else
             {
-                f.current.at(i) = l + lcp( a.substr(l), b.substr(i - f.offset + l) );
+                const unsigned int bPos = i - f.offset + l;
+                f.current[i] = l + lcp(a + l, b + bPos, MIN(aLength - l, bLength - bPos));
             }    
     }
 
@@ -199,33 +561,26 @@ inline void front(const std::string& a, const std::string& b, frontMatrix& f)
 
 //output sensitive -> O() depends on the mismatches that we allow, since we allow mostly just for a few it runs super fast...
 //no backtracking implemented for now, only used to align UMIs where we do not care about alingment start, end
-inline bool outputSense(const std::string& sequence, const std::string& pattern, const int& mismatches, int& score)
+inline bool outputSense(const char* sequence, const unsigned int& m, const char* pattern, const unsigned int& n,
+                        const int& mismatches, int& score)
 {
-    const unsigned int m = sequence.length();
-    const unsigned int n = pattern.length();
-    
-    frontMatrix f(m,n);
+    static thread_local frontMatrix f;
+    f.reset(m,n);
     f.offset = m + 1;
     f.d = 0;
 
-    f.current.at(f.offset) = lcp(sequence, pattern);
-    if(f.current.at(n-m+f.offset) == m)
+    f.current[f.offset] = lcp(sequence, pattern, MIN(m, n));
+    if(f.current[n-m+f.offset] == m)
     {
         score = f.d;
         return true;
-        if(score <= mismatches){return true;}
-        else
-        {
-            score = mismatches + 1;
-            return false;
-        }
     }
 
     ++f.d;
     while(f.d <= MIN(MAX(m,n), mismatches))
     {
-        front(sequence, pattern, f);
-        if(f.current.at(n-m+f.offset) == m )
+        front(sequence, m, pattern, n, f);
+        if(f.current[n-m+f.offset] == m )
         {
             score = f.d;
             if(score <= mismatches)
@@ -245,6 +600,10 @@ inline bool outputSense(const std::string& sequence, const std::string& pattern,
     score = mismatches + 1;
     return false;
 }
+inline bool outputSense(const std::string& sequence, const std::string& pattern, const int& mismatches, int& score)
+{
+    return outputSense(sequence.data(), sequence.length(), pattern.data(), pattern.length(), mismatches, score);
+}
 
 //levenshtein distance, implemented with backtracking to get start and end of alingment, however slower than output sensitive algorithm:
 //used for parser so far: it has an additional flavor of unpunished deletions at the start and end of the alignment
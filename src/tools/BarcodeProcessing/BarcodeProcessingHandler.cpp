@@ -86,6 +86,7 @@ void generateBarcodeDicts(std::string barcodeFile, std::string barcodeIndices, N
 
     //write a mapping of barcode sequence to a unique number for each
     //CI barcoding round
+    scKey maxSingleCellNumber = 1;
     for(const int& i : barcodeIdData.NBarcodeIndices)
     {
         int barcodeCount = 0;
@@ -97,6 +98,17 @@ void generateBarcodeDicts(std::string barcodeFile, std::string barcodeIndices, N
             ++barcodeCount;
         }
         barcodeIdData.barcodeIdDict.push_back(barcodeMap);
+
+        //the single cell index is a mixed radix number with one digit per barcoding round: 
+        //the product of all barcode numbers must fit into the single cell index
+        scKey radix = (barcodeCount > 0) ? barcodeCount : 1;
+        if(maxSingleCellNumber > (ULLONG_MAX / radix))
+        {
+            std::cerr << "PARAMETER ERROR: The number of possible barcode combinations for the CI-barcodes exceeds 2^64, single cells can not be indexed!\n";
+            exit(EXIT_FAILURE);
+        }
+        maxSingleCellNumber *= radix;
+        barcodeIdData.barcodeIdRadix.push_back(radix);
     }
 
     barcodeIdData.NTreatmentIdx = treatmentIdx;
@@ -110,13 +122,41 @@ void generateBarcodeDicts(std::string barcodeFile, std::string barcodeIndices, N
     }
 }
 
-void BarcodeProcessingHandler::generate_unique_sc_to_class_dict(const std::unordered_map< const char*, 
+void singleCellIndexToBarcodeIds(scKey scIdx, const NBarcodeInformation& barcodeIdData, std::vector<int>& barcodeIds)
+{
+    //the last barcoding round is the least significant digit
+    barcodeIds.resize(barcodeIdData.barcodeIdRadix.size());
+    for(int i = barcodeIdData.barcodeIdRadix.size() - 1; i >= 0; --i)
+    {
+        barcodeIds.at(i) = scIdx % barcodeIdData.barcodeIdRadix.at(i);
+        scIdx /= barcodeIdData.barcodeIdRadix.at(i);
+    }
+}
+
+std::string singleCellIndexToName(const scKey& scIdx, const NBarcodeInformation& barcodeIdData)
+{
+    std::vector<int> barcodeIds;
+    singleCellIndexToBarcodeIds(scIdx, barcodeIdData, barcodeIds);
+
+    std::string scName;
+    for(size_t i = 0; i < barcodeIds.size(); ++i)
+    {
+        scName += std::to_string(barcodeIds.at(i));
+        if(i + 1 < barcodeIds.size())
+        {
+            scName += ".";
+        }
+    }
+    return scName;
+}
+
+void BarcodeProcessingHandler::generate_unique_sc_to_class_dict(const std::unordered_map< scKey, 
                                                                 std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict)
 {
-    std::unordered_map< const char*, const char*> scClassDict;
+    std::unordered_map< scKey, const char*> scClassDict;
 
     //calculate real class for each single cell
-    std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>::const_iterator it;
+    std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>::const_iterator it;
     for (it = scClasseCountDict.begin(); it != scClasseCountDict.end(); it++)
     {
         //count the read for each class for the single cell
@@ -143,7 +183,7 @@ void BarcodeProcessingHandler::generate_unique_sc_to_class_dict(const std::unord
         //add class for single cell to dict
         if(foundUniqueClass)
         {
-            scClassDict.insert(std::pair<const char*, const char*>(it->first, realClass));
+            scClassDict.insert(std::pair<scKey, const char*>(it->first, realClass));
             guideCountPerSC.insert(std::make_pair(it->first, realReads));
         }
         else
@@ -158,6 +198,9 @@ void BarcodeProcessingHandler::generate_unique_sc_to_class_dict(const std::unord
 
 void BarcodeProcessingHandler::parse_combined_file(const std::string fileName, const int& thread)
 {
+    runReport.start_stage("parse");
+    TRACE_SPAN("io", "parse demultiplexed reads");
+    parsedFiles.push_back(fileName);
     unsigned long long totalReads = totalNumberOfLines(fileName);
     unsigned long long currentReads = 0;
     //open gz file
@@ -172,8 +215,11 @@ void BarcodeProcessingHandler::parse_combined_file(const std::string fileName, c
     inbuf.push(file);
     std::istream instream(&inbuf);
     
-    std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>> scClasseCountDict;
+    if(maxMemory > 0){start_sample(totalReads);}
+    std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>> scClasseCountDict;
     parseBarcodeLines(&instream, totalReads, currentReads, scClasseCountDict);
+    //files with less reads than the sample
+    if(spillTotalReads > 0){start_spilling();}
 
     //finally add the class of each single cell if we also have class labels (e.g. guide data)
     if(rawData.check_class())
@@ -182,11 +228,16 @@ void BarcodeProcessingHandler::parse_combined_file(const std::string fileName, c
     }
 
     file.close();
+    record_memory("parse", &scClasseCountDict);
+    runReport.end_stage("parse", currentReads);
 }
 
 void BarcodeProcessingHandler::parse_file_seperately(const std::string fileName, const int& thread, 
-                                         std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict)
+                                         std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict)
 {
+    runReport.start_stage("parse");
+    TRACE_SPAN("io", "parse demultiplexed reads");
+    parsedFiles.push_back(fileName);
     unsigned long long totalReads = totalNumberOfLines(fileName);
     unsigned long long currentReads = 0;
     //open gz file
@@ -201,13 +252,18 @@ void BarcodeProcessingHandler::parse_file_seperately(const std::string fileName,
     inbuf.push(file);
     std::istream instream(&inbuf);
     
+    //only AB reads r spilled, guide reads r only counted per single cell
+    if(maxMemory > 0 && scClasseCountDict == nullptr){start_sample(totalReads);}
     parse_barcode_lines_seperately(&instream, totalReads, currentReads, scClasseCountDict);
+    if(spillTotalReads > 0){start_spilling();}
 
     file.close();
+    record_memory("parse", scClasseCountDict);
+    runReport.end_stage("parse", currentReads);
 }
 
 void BarcodeProcessingHandler::parse_barcode_lines_seperately(std::istream* instream, const unsigned long long& totalReads, unsigned long long& currentReads, 
-                                                 std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict)
+                                                 std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict)
 {
     std::string line;
     std::cout << "STEP[1/3]\t(READING ALL LINES INTO MEMORY)\n";
@@ -215,6 +271,9 @@ void BarcodeProcessingHandler::parse_barcode_lines_seperately(std::istream* inst
     int elements = 0; //check that each row has the correct number of barcodes
     unsigned long long abReadCount = 0;
     unsigned long long guideReadCount = 0;
+    //the progress is printed from a seperate thread
+    std::atomic<unsigned long long> parsedReads = 0;
+    ProgressReporter progress([&parsedReads]{return parsedReads.load(std::memory_order_relaxed);}, totalReads);
     while(std::getline(*instream, line))
     {
         //for the first read check the positions in the string that refer to CIBarcoding positions
@@ -227,9 +286,8 @@ void BarcodeProcessingHandler::parse_barcode_lines_seperately(std::istream* inst
         }
         add_line_to_temporary_data(line, elements, scClasseCountDict, abReadCount, guideReadCount);   
 
-        double perc = currentReads/ (double)totalReads;
         ++currentReads;
-        printProgress(perc);        
+        add_to_counter(parsedReads);
     }
 
     if(scClasseCountDict == nullptr)
@@ -241,12 +299,11 @@ void BarcodeProcessingHandler::parse_barcode_lines_seperately(std::istream* inst
         result.set_total_guide_reads(guideReadCount);
     }
 
-    printProgress(1);
-    std::cout << "\n";
+    progress.stop();
 }
 
-void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& line, const int& elements,
-   std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict,
+unsigned long long BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& line, const int& elements,
+   std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict,
    unsigned long long& abReadCount, unsigned long long& guideReadCount)
 {
     //split the line into barcodes
@@ -262,16 +319,14 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
     if(result.size() != elements)
     {
         std::cout << "Warning in barcode file, following row has not the correct number of sequences: " << line << "\n";
-        return;
+        return 1;
     }
 
-    //hand over the UMI string, ab string, singleCellstring (concatenation of CIbarcodes)
-    std::vector<std::string> ciBarcodes;
-    for(int i : fastqReadBarcodeIdx)
-    {
-        ciBarcodes.push_back(result.at(i));
-    }
-    std::string singleCellIdx = generateSingleCellIndexFromBarcodes(ciBarcodes);
+    //lines of a collapsed demultiplexed file stand for several identical reads
+    const unsigned long long readCount = (countIdx != INT_MAX) ? std::stoull(result.at(countIdx)) : 1;
+
+    //hand over the UMI string, ab string, singleCell index (mixed radix number of CIbarcodes)
+    scKey singleCellIdx = generateSingleCellIndexFromBarcodes(result);
     
     std::string proteinName = "";
     if(scClasseCountDict == nullptr)
@@ -282,7 +337,7 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
     {
         std::string name = rawData.getClassName(result.at(abIdx));
 
-        ++guideReadCount;
+        guideReadCount += readCount;
         const char* umiSeq;
         std::string umiSeqString;
         if(!umiIdx.empty())
@@ -300,7 +355,7 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
         }
 
         rawData.add_tmp_class_line(name, singleCellIdx, *scClasseCountDict, umiSeq);
-        return;
+        return readCount;
     }
     
     std::string treatment = "";
@@ -309,7 +364,7 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
         treatment = rawData.getTreatmentName(result.at(treatmentIdx));
     }
 
-    ++abReadCount;
+    abReadCount += readCount;
     const char* umiSeq;
     //if there is a UMI and also we should filter reads by the fact that a UMI should belong only to one SC-AB
     //the also create a UMI-SCAB Dict for filtering
@@ -325,13 +380,14 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
         }
         umiSeq = umiSeqString.c_str();
 
-        rawData.add_to_umiDict(umiSeq, proteinName, singleCellIdx, treatment);
+        store_read(umiSeq, proteinName, singleCellIdx, treatment, readCount);
     }
     //otherwise add reads directly to dict of ScAb to reads
     else
     {
-        rawData.add_to_scAbDict("", proteinName, singleCellIdx, treatment);
+        store_read("", proteinName, singleCellIdx, treatment, readCount);
     }
+    return readCount;
 }
 
 void BarcodeProcessingHandler::parse_ab_and_guide_file(const std::string abFileName, 
@@ -343,16 +399,17 @@ void BarcodeProcessingHandler::parse_ab_and_guide_file(const std::string abFileN
 
     //parse guide file
     //finally add the class of each single cell
-    std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>> scClasseCountDict;
+    std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>> scClasseCountDict;
     parse_file_seperately(guideFileName, thread, &scClasseCountDict);
     generate_unique_sc_to_class_dict(scClasseCountDict);
 
     //combine results
-    result.set_total_reads(result.get_log_data().totalAbReads + result.get_log_data().totalGuideReads); //minus header line
+    const ProcessingLog logData = result.get_log_data();
+    result.set_total_reads(logData.totalAbReads + logData.totalGuideReads); //minus header line
 }
 
 void BarcodeProcessingHandler::parseBarcodeLines(std::istream* instream, const unsigned long long& totalReads, unsigned long long& currentReads, 
-                                                 std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict)
+                                                 std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict)
 {
     std::string line;
     std::cout << "STEP[1/3]\t(READING ALL LINES INTO MEMORY)\n";
@@ -360,6 +417,10 @@ void BarcodeProcessingHandler::parseBarcodeLines(std::istream* instream, const u
     int elements = 0; //check that each row has the correct number of barcodes
     unsigned long long abReadCount = 0;
     unsigned long long guideReadCount = 0;
+    unsigned long long lineReadCount = 0; //reads of all lines (lines of collapsed files can be several reads)
+    //the progress is printed from a seperate thread
+    std::atomic<unsigned long long> parsedReads = 0;
+    ProgressReporter progress([&parsedReads]{return parsedReads.load(std::memory_order_relaxed);}, totalReads);
     while(std::getline(*instream, line))
     {
         //for the first read check the positions in the string that refer to CIBarcoding positions
@@ -368,23 +429,21 @@ void BarcodeProcessingHandler::parseBarcodeLines(std::istream* instream, const u
             getBarcodePositions(line, elements);
             continue;
         }
-        add_line_to_temporary_data(line, elements, scClasseCountDict, abReadCount, guideReadCount);   
+        lineReadCount += add_line_to_temporary_data(line, elements, scClasseCountDict, abReadCount, guideReadCount);   
 
-        double perc = currentReads/ (double)totalReads;
         ++currentReads;
-        printProgress(perc);        
+        add_to_counter(parsedReads);
     }
 
-    result.set_total_reads(currentReads-1); //minus header line
+    result.set_total_reads(lineReadCount);
     result.set_total_ab_reads(abReadCount);
     result.set_total_guide_reads(guideReadCount);
 
-    printProgress(1);
-    std::cout << "\n";
+    progress.stop();
 }
 
-void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& line, const int& elements,
-   std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict,
+unsigned long long BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& line, const int& elements,
+   std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict,
    unsigned long long& abReadCount, unsigned long long& guideReadCount)
 {
     //split the line into barcodes
@@ -400,16 +459,14 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
     if(result.size() != elements)
     {
         std::cout << "WARNING in barcode file, following row has not the correct number of sequences: " << line << "\n";
-        return;
+        return 1;
     }
 
-    //hand over the UMI string, ab string, singleCellstring (concatenation of CIbarcodes)
-    std::vector<std::string> ciBarcodes;
-    for(int i : fastqReadBarcodeIdx)
-    {
-        ciBarcodes.push_back(result.at(i));
-    }
-    std::string singleCellIdx = generateSingleCellIndexFromBarcodes(ciBarcodes);
+    //lines of a collapsed demultiplexed file stand for several identical reads
+    const unsigned long long readCount = (countIdx != INT_MAX) ? std::stoull(result.at(countIdx)) : 1;
+
+    //hand over the UMI string, ab string, singleCell index (mixed radix number of CIbarcodes)
+    scKey singleCellIdx = generateSingleCellIndexFromBarcodes(result);
     
     std::string proteinName = "";
     if(rawData.check_class())
@@ -418,7 +475,7 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
         std::string name = rawData.get_protein_or_class_name(result.at(abIdx), classLine);
         if(classLine)
         {
-            ++guideReadCount;
+            guideReadCount += readCount;
 
             const char* umiSeq;
             if(!umiIdx.empty())
@@ -437,7 +494,7 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
             }
 
             rawData.add_tmp_class_line(name, singleCellIdx, scClasseCountDict, umiSeq);
-            return;
+            return readCount;
         }
         else
         {
@@ -455,7 +512,7 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
         treatment = rawData.getTreatmentName(result.at(treatmentIdx));
     }
 
-    ++abReadCount;
+    abReadCount += readCount;
     const char* umiSeq;
     //if there is a UMI and also we should filter reads by the fact that a UMI should belong only to one SC-AB
     //the also create a UMI-SCAB Dict for filtering
@@ -470,28 +527,27 @@ void BarcodeProcessingHandler::add_line_to_temporary_data(const std::string& lin
             umiSeqString = umiSeqString + tmpUmi;
         }
         umiSeq = umiSeqString.c_str();
-        rawData.add_to_umiDict(umiSeq, proteinName, singleCellIdx, treatment);
+        store_read(umiSeq, proteinName, singleCellIdx, treatment, readCount);
     }
     //otherwise add reads directly to dict of ScAb to reads
     else
     {
-        rawData.add_to_scAbDict("", proteinName, singleCellIdx, treatment);
+        store_read("", proteinName, singleCellIdx, treatment, readCount);
     }
+    return readCount;
 }
 
-std::string BarcodeProcessingHandler::generateSingleCellIndexFromBarcodes(std::vector<std::string> ciBarcodes)
+scKey BarcodeProcessingHandler::generateSingleCellIndexFromBarcodes(const std::vector<std::string>& barcodes)
 {
-    std::string scIdx;
+    scKey scIdx = 0;
 
-    for(int i = 0; i < ciBarcodes.size(); ++i)
+    for(size_t i = 0; i < fastqReadBarcodeIdx.size(); ++i)
     {
-        std::string barcodeAlternative = ciBarcodes.at(i);
-        int tmpIdx = varyingBarcodesPos.barcodeIdDict.at(i)[barcodeAlternative];
-        scIdx += std::to_string(tmpIdx);
-        if(i < ciBarcodes.size() - 1)
-        {
-            scIdx += ".";
-        }
+        const std::unordered_map<std::string, int>& barcodeIds = varyingBarcodesPos.barcodeIdDict.at(i);
+        std::unordered_map<std::string, int>::const_iterator barcodeIt = barcodeIds.find(barcodes.at(fastqReadBarcodeIdx.at(i)));
+        //unknown barcodes get the id zero (as it was the case when indexing with a dot seperated string)
+        int tmpIdx = (barcodeIt != barcodeIds.end()) ? barcodeIt->second : 0;
+        scIdx = scIdx * varyingBarcodesPos.barcodeIdRadix.at(i) + tmpIdx;
     }
 
     return scIdx;
@@ -508,8 +564,13 @@ void BarcodeProcessingHandler::getBarcodePositions(const std::string& line, int&
     while(std::getline(ss, substr, '\t'))
     {
         if(substr.empty()){continue;}
+        //number of identical reads in collapsed files
+        if(substr == "COUNT")
+        {
+            countIdx = count;
+        }
         //if substr is only N's
-        if(substr.find_first_not_of('N') == std::string::npos)
+        else if(substr.find_first_not_of('N') == std::string::npos)
         {
             //add index for treatment
             if(variableBarcodeCount == varyingBarcodesPos.NTreatmentIdx)
@@ -543,163 +604,116 @@ void BarcodeProcessingHandler::getBarcodePositions(const std::string& line, int&
 
 //all reads of the same UMI are combined -> written to a dict for an AB of a unique cell (this read is stored only once, there can already be seen
 //as a UMI collapsing step)
-void BarcodeProcessingHandler::markReadsWithNoUniqueUmi(const std::vector<umiDataLinePtr>& uniqueUmis,
-                                                        std::atomic<unsigned long long>& count,
-                                                        const unsigned long long& totalCount)
+void BarcodeProcessingHandler::markReadsWithNoUniqueUmi(const readGroup& uniqueUmis,
+                                                        ThreadCounter& count)
 {
-    //count how often we see which AB-SC combinations for this certain UMI
-    std::unordered_map<std::string, unsigned long long> umiCountMap;
-    std::unordered_map<std::string, umiDataLinePtr> umiReadMap; //mapping the unique ID to the first occuring actual read
-
-    unsigned long long totalReadCount = uniqueUmis.size();
-    for(unsigned long long i = 0; i < uniqueUmis.size(); ++i)
+    const dataLineArena& lines = rawData.getDataLines();
+    unsigned long long totalReadCount = 0;
+    for(const dataLineIdx& line : uniqueUmis){totalReadCount += lines.readCount[line];}
+
+    //count how often we see which AB-SC combinations for this certain UMI: sort the reads by AB-SC (and their position for the same AB-SC)
+    //so each combination is a run of reads, starting with its first occuring actual read
+    //the vector is reused for all UMIs of this thread (no allocation per UMI)
+    static thread_local std::vector<umiRead> umiReads;
+    umiReads.clear();
+    for(dataLineIdx i = 0; i < uniqueUmis.size(); ++i)
     {
-        std::string uniqueID = std::string(uniqueUmis.at(i)->scID) + std::string(uniqueUmis.at(i)->abName);
-        std::unordered_map<std::string, unsigned long long>::iterator umiCountMapIt = umiCountMap.find(uniqueID);
-        if( umiCountMapIt != umiCountMap.end())
-        {
-            ++(umiCountMapIt->second);
-        }
-        else
-        {
-            umiCountMap.insert(std::make_pair(uniqueID, 1));
-            umiReadMap.insert(std::make_pair(uniqueID, uniqueUmis.at(i)));
-        }
-    }
-    //check there is a single cell + AB combination representing more than 90% of the UMI reads
-    std::vector<std::string> realSingleCellIDVec;
-    bool realSingleCellExists = false;
-    for(auto singleCellCountPair : umiCountMap)
-    {
-        double singleCellPerc = (double)singleCellCountPair.second/totalReadCount;
-        if( singleCellPerc >= umiFilterThreshold) //default = 0.9
-        {
-            realSingleCellIDVec.push_back(singleCellCountPair.first);
-            realSingleCellExists = true;
-            if(umiFilterThreshold>0.5){break;} //in this case we have only one entry in the vector
-        }
+        umiReads.push_back(umiRead{AbScKey(lines.ab_name(uniqueUmis[i]), lines.scID[uniqueUmis[i]]), i});
     }
-    //Collapse UMIs, remove false reads, map a single cell class name to single cells
+    std::sort(umiReads.begin(), umiReads.end());
+
+    //Collapse UMIs, remove false reads, map a single cell class name to single cells:
+    //keep a single cell + AB combination only if it represents more than 90% of the UMI reads
     unsigned long long readsWithNoClass = 0;
     unsigned long long readsToKeep = 0;
-    if(realSingleCellExists)
+    for(size_t runStart = 0; runStart < umiReads.size();)
     {
-        //delete only the <=10% 'false' reads
-        for(auto it = umiReadMap.begin(); it != umiReadMap.end(); it++)
+        size_t runEnd = runStart + 1;
+        unsigned long long abScReadCount = lines.readCount[uniqueUmis[umiReads[runStart].position]];
+        while(runEnd < umiReads.size() && umiReads[runEnd].key == umiReads[runStart].key)
         {
-            std::string uniqueID = it->first;
-            if(std::find(realSingleCellIDVec.begin(), realSingleCellIDVec.end(), uniqueID) != realSingleCellIDVec.end())//add to new DIct
-            {
-                    const char* className = nullptr;
-                    if(rawData.check_class())
-                    {
-                        className = rawData.get_sc_class_name(it->second->scID);
-                        if(className == nullptr && scMustHaveClass)
-                        {
-                            //single cell has no class name
-                            readsWithNoClass += umiCountMap.at(uniqueID);
-                            if(umiFilterThreshold>0.5){break;}
-                            else{continue;}
-                        }
-                        else if(className == nullptr && !scMustHaveClass)
-                        {
-                            className = "wildtype";
-                        }
-                    }
-
-                    //add ABSc dataLine
-                    writeToRawDataLock.lock(); //maybe better lock inside the rawData (keep in mind)
-                    rawData.add_to_scAbDict(it->second, umiCountMap.at(uniqueID), className);
-                    writeToRawDataLock.unlock();
+            abScReadCount += lines.readCount[uniqueUmis[umiReads[runEnd].position]];
+            ++runEnd;
+        }
+        const dataLineIdx firstRead = uniqueUmis[umiReads[runStart].position];
+        runStart = runEnd;
 
-                    readsToKeep += umiCountMap.at(uniqueID);
+        double singleCellPerc = (double)abScReadCount/totalReadCount;
+        if( singleCellPerc < umiFilterThreshold) //default = 0.9
+        {
+            continue;
+        }
 
-                    //ONLY the first encountered real read with unique UMI (>90%) is written into dict
-                    if(umiFilterThreshold>0.5){break;}
+        charHandle className = dataLineArena::noString;
+        if(rawData.check_class())
+        {
+            className = rawData.get_sc_class(lines.scID[firstRead]);
+            if(className == dataLineArena::noString && scMustHaveClass)
+            {
+                //single cell has no class name
+                readsWithNoClass += abScReadCount;
+                if(umiFilterThreshold>0.5){break;}
+                else{continue;}
+            }
+            else if(className == dataLineArena::noString && !scMustHaveClass)
+            {
+                className = rawData.get_wildtype_class();
             }
         }
-        if(readsWithNoClass > 0)
+
+        //add ABSc dataLine (when grouping by sorting the line is only marked, no dict to lock)
+        if(rawData.getReadGrouping() == ReadGrouping::hash)
         {
-            result.add_removed_reads_class(readsWithNoClass);
+            TRACE_LOCK(writeToRawDataLock, "writeToRawDataLock"); //maybe better lock inside the rawData (keep in mind)
+            rawData.add_to_scAbDict(firstRead, abScReadCount, totalReadCount, className);
+            writeToRawDataLock.unlock();
+        }
+        else
+        {
+            rawData.add_to_scAbDict(firstRead, abScReadCount, totalReadCount, className);
         }
-    }
-    result.add_removed_reads_umi(totalReadCount - (readsToKeep + readsWithNoClass) );
-
-    if( (totalCount >= 100) && (count % (totalCount / 100) == 0) )
-    {
-        statusUpdateLock.lock();
-        double perc = count/ (double) totalCount;
-        printProgress(perc);
-        statusUpdateLock.unlock();
-    }
-    ++count;
-}
 
+        readsToKeep += abScReadCount;
 
-void BarcodeProcessingHandler::count_umi_occurence(std::vector<int>& positionsOfSameUmi, 
-                                                   umiCount& umiLineTmp,
-                                                   const std::vector<dataLinePtr>& allScAbCounts,
-                                                   const int& umiMismatches,
-                                                   const int& lastIdx)
-{
-    unsigned long long numberAlignedUmis = 0;
-    for(int j = 0; j < (allScAbCounts.size() - 1); ++j)
+        //ONLY the first encountered real read with unique UMI (>90%) is written into dict
+        if(umiFilterThreshold>0.5){break;}
+    }
+    if(readsWithNoClass > 0)
     {
-        //calling outputSense algorithm, much faster than levenshtein O(e*max(m,n))
-        //however is recently implemented without backtracking
-        //before umiMismatches was increased by the length difference between the two UMIs 
-        //(no longer done, those deletion should probably be considered as part of the allowed umiMismatches)
-        const char* umia = allScAbCounts.at(lastIdx)->umiSeq;
-        const char* umib = allScAbCounts.at(j)->umiSeq;
-        int dist = INT_MAX;
-        int start = 0;
-        int end = 0;
-        bool similar = outputSense(umia, umib, umiMismatches, dist);
-
-        //if mismatches are within range, change UMI seq
-        //the new 'correct' UMI sequence is the one of umiLength, if both r of
-        //same length, its the first occuring UMI
-        if(dist <= umiMismatches)
-        {
-            if(dist > 0)
-            {
-                ++numberAlignedUmis;
-            }
-            //UMIs are not corrected in rawData (the rawData keeps the 'wrong' umi sequences)
-            //they could be changed by calling 'changeUmi'
-            positionsOfSameUmi.push_back(j);     
-            
-            umiLineTmp.abCount += allScAbCounts.at(j)->umiCount; // increase count for this UMI
-        }
+        result.add_removed_reads_class(readsWithNoClass);
     }
-    result.add_umi_mismatches(numberAlignedUmis);
+    result.add_removed_reads_umi(totalReadCount - (readsToKeep + readsWithNoClass) );
+
+    count.add();
 }
 
-void BarcodeProcessingHandler::count_abs_per_single_cell(const int& umiMismatches, const std::vector<dataLinePtr>& uniqueAbSc,
-                                                        std::atomic<unsigned long long>& count,
-                                                        const unsigned long long& totalCount,
-                                                        std::shared_ptr<std::unordered_map<const char*, std::vector<umiDataLinePtr>, 
-                                                        CharHash, CharPtrComparator>>& umiMap)
+
+void BarcodeProcessingHandler::count_abs_per_single_cell(const int& umiMismatches, const readGroup& uniqueAbSc,
+                                                        ThreadCounter& count,
+                                                        WorkStealingExecutor* groupExecutor)
 {
         //correct for UMI mismatches and fill the AbCountvector
         //iterate through same AbScIdx, calculate levenshtein dist for all UMIs and match those with a certain number of mismatches
 
         //all dataLines for this AB SC combination
-        std::vector<dataLinePtr> scAbCounts = uniqueAbSc;
+        static thread_local std::vector<dataLineIdx> scAbCounts;
+        scAbCounts.assign(uniqueAbSc.begin(), uniqueAbSc.end());
+        const dataLineArena& lines = rawData.getDataLines();
 
         //data structures to be filled for the UMI and AB count
         scAbCount abLineTmp; // we fill only this one AB SC count
         umiCount umiLineTmp;
 
-        abLineTmp.scID = umiLineTmp.scID = uniqueAbSc.at(0)->scID;
-        abLineTmp.abName = umiLineTmp.abName = uniqueAbSc.at(0)->abName;
-        abLineTmp.treatment = umiLineTmp.treatment = uniqueAbSc.at(0)->treatmentName;
-        abLineTmp.className = uniqueAbSc.at(0)->cellClassname;
+        abLineTmp.scID = umiLineTmp.scID = lines.scID[uniqueAbSc.front()];
+        abLineTmp.abName = umiLineTmp.abName = lines.ab_name(uniqueAbSc.front());
+        abLineTmp.treatment = umiLineTmp.treatment = lines.treatment_name(uniqueAbSc.front());
+        abLineTmp.className = lines.cell_classname(uniqueAbSc.front());
 
         //if we have no umis erase whole vector and count every element
-        if(std::string(scAbCounts.back()->umiSeq) == "" )
+        if(lines.umi_seq(scAbCounts.back())[0] == '\0')
         {
-            abLineTmp.abCount = scAbCounts.size();
+            abLineTmp.abCount = 0;
+            for(const dataLineIdx& line : scAbCounts){abLineTmp.abCount += lines.readCount[line];}
             scAbCounts.clear();
         }
         else
@@ -708,54 +722,37 @@ void BarcodeProcessingHandler::count_abs_per_single_cell(const int& umiMismatche
             //reads get a value for dsitance to UMi length (one Base plus minus gets same value)
             //and are then sorted in decreasing fashion (when comparing UMIs a UMI of length umilength is chosen first)
             //to minimize erros bcs e.g. three reads are within 2MM but we choose one UMI out the outer end regarding MM
-            sort(scAbCounts.rbegin(), scAbCounts.rend(), less_than_umi(umiLength, umiMap));
+            sort(scAbCounts.rbegin(), scAbCounts.rend(), less_than_umi(umiLength, lines));
         }
-        //we take always last element in vector of read of same AB and SC ID
-        //then store all reads wwhere UMIs are within distance, and delete those line, and sum up the AB count by one
-        while(!scAbCounts.empty())
+        //we take always last element in vector of read of same AB and SC ID as center
+        //then collapse all reads wwhere UMIs are within distance, and sum up the AB count by one (see UmiClusterer)
+        static thread_local UmiClusterer clusterer;
+        static thread_local std::vector<const char*> umis;
+        static thread_local std::vector<unsigned long long> readCounts;
+        static thread_local std::vector<umiCluster> clusters;
+        umis.clear();
+        readCounts.clear();
+        for(const dataLineIdx& line : scAbCounts)
         {
-            dataLinePtr lastAbSc = scAbCounts.back();
-            int lastIdx = scAbCounts.size() - 1;
-
-            //check if we have to delete element anyways, bcs umi is too long
-            if( std::abs(int( strlen(lastAbSc->umiSeq) - umiLength )) >  umiMismatches)
-            {
-                scAbCounts.pop_back();
-                continue;
-            }
-
-            //if in last element
-            if(scAbCounts.size() == 1)
-            {
-                ++abLineTmp.abCount;
-                umiLineTmp.abCount += lastAbSc->umiCount; 
-                umiLineTmp.umi = lastAbSc->umiSeq;
-
-                result.add_umi_count(umiLineTmp);
-                scAbCounts.pop_back();
-                break;
-            }
-
-            //otherwise conmpare all and mark the ones to delete
-            std::vector<int> deletePositions;
-            umiLineTmp.abCount += lastAbSc->umiCount; //count the first occurence
-            //count all occurences of the last UMI for this AB-SC
-            count_umi_occurence(deletePositions, umiLineTmp, scAbCounts, umiMismatches, lastIdx);
-            deletePositions.push_back(lastIdx);
+            umis.push_back(lines.umi_seq(line));
+            readCounts.push_back(lines.umiCount[line]);
+        }
+        unsigned long long numberAlignedUmis = 0;
+        clusterer.set_parameters(umiMismatches, umiLength, umiClusteringMode, umiDistance, umiNeighbourhoodMinUmis);
+        clusterer.cluster(umis, readCounts, clusters, numberAlignedUmis, groupExecutor);
+        if(numberAlignedUmis > 0)
+        {
+            result.add_umi_mismatches(numberAlignedUmis);
+        }
 
-            //ADD UMI if exists
-            if(umiLineTmp.abCount > 0)
+        for(const umiCluster& cluster : clusters)
+        {
+            //ADD UMI if exists (the last remaining UMI is always added)
+            umiLineTmp.abCount = cluster.readCount;
+            if(cluster.lastUmi || umiLineTmp.abCount > 0)
             {
-                umiLineTmp.umi = lastAbSc->umiSeq;
+                umiLineTmp.umi = umis[cluster.center];
                 result.add_umi_count(umiLineTmp);
-                umiLineTmp.abCount = 0; //reset the count for this umi, all other variables stay the same (Ab name, cellID, etc...)
-            }
-
-            //delte all same UMIs
-            for(int posIdx = (deletePositions.size() - 1); posIdx >= 0; --posIdx)
-            {
-                int pos = deletePositions.at(posIdx);
-                scAbCounts.erase(scAbCounts.begin() + pos);
             }
 
             //increase AB count for this one UMI
@@ -768,14 +765,7 @@ void BarcodeProcessingHandler::count_abs_per_single_cell(const int& umiMismatche
             result.add_ab_count(abLineTmp);
         }
 
-        if((totalCount >= 100) && (count % (totalCount / 100) == 0))
-        {
-            statusUpdateLock.lock();
-            double perc = count/ (double) totalCount;
-            printProgress(perc);
-            statusUpdateLock.unlock();
-        }
-        ++count;
+        count.add();
 }
 
 void BarcodeProcessingHandler::processBarcodeMapping(const int& umiMismatches, const int& thread)
@@ -786,55 +776,261 @@ void BarcodeProcessingHandler::processBarcodeMapping(const int& umiMismatches, c
 
     //check all UMIs and keep their reads only if they are for >90% a unique scID, ABname, treatmentname
     //also collapse UMIs, and assign the className to each new dataLine, dataLines are now stored as const lines and can no longer be changed
-    std::atomic<unsigned long long> umiCount = 0; //using atomic<int> as thread safe read count
-    unsigned long long totalCount = rawData.getUniqueUmis()->size();
+    remove_reads_of_non_unique_umis(thread);
+    count_abs_of_kept_reads(umiMismatches, thread);
+}
+
+void BarcodeProcessingHandler::remove_reads_of_non_unique_umis(const int& thread)
+{
+    runReport.start_stage("UMI filter");
+    TRACE_SPAN("processing", "UMI filter");
+    ThreadCounter umiCount; //every thread counts its processed UMIs, the progress is printed from a seperate thread
 
-    boost::asio::thread_pool pool_1(thread); //create thread pool
     std::cout << "STEP[2/3]\t(Remove all reads for a UMI with <90% coming from same AB/SC combination)\n";
-    const std::shared_ptr< std::unordered_map<const char*, std::vector<umiDataLinePtr>, CharHash, CharPtrComparator>> umiMap = rawData.getUniqueUmis();
-    if(!umiMap->empty())
+    //the groups only reference the line indices, which r not changed during step 2
+    std::vector<readGroup> umiReads;
+    rawData.get_umi_groups(umiReads, thread);
+    if(!umiReads.empty())
     {
-        for(std::unordered_map<const char*, std::vector<umiDataLinePtr>, CharHash, CharPtrComparator>::const_iterator it = umiMap->begin(); 
-        it != umiMap->end(); 
-        it++)    
-        {
-            //careful: uniqueUmi goe sout of scope after enqueuing, therefore just copied...
-            boost::asio::post(pool_1, std::bind(&BarcodeProcessingHandler::markReadsWithNoUniqueUmi, this, 
-                                            std::cref(it->second), 
-                                            std::ref(umiCount), std::cref(totalCount)));
-        }
-        pool_1.join();
-        printProgress(1);
-        std::cout << "\n";
+        ProgressReporter progress([&umiCount]{return umiCount.total();}, umiReads.size());
+        //sorting the reads of a UMI is the main cost
+        WorkStealingExecutor executor(thread);
+        executor.run(umiReads.size(),
+                     [&](const size_t& i){markReadsWithNoUniqueUmi(umiReads[i], umiCount);},
+                     [&](const size_t& i){return((unsigned long long)umiReads[i].size());});
+        progress.stop();
     }
+    record_memory("UMI filter");
+    runReport.end_stage("UMI filter", rawData.getDataLines().size());
+}
 
+void BarcodeProcessingHandler::count_abs_of_kept_reads(const int& umiMismatches, const int& thread)
+{
     //generate ABcounts per single cell:
-    umiCount = 0; //using atomic<int> as thread safe read count
-    totalCount = rawData.getUniqueAbSc()->size();
-    boost::asio::thread_pool pool_3(thread); //create thread pool
+    runReport.start_stage("collapse");
+    TRACE_SPAN("processing", "collapse");
+    ThreadCounter abScCount;
     std::cout << "STEP[3/3]\t(Count reads for AB in single cells)\n";
-            
-    std::shared_ptr<std::unordered_map<const char*, std::vector<umiDataLinePtr>, 
-                    CharHash, CharPtrComparator>> uniqueUmiMap = 
-                    rawData.getUniqueUmis();
+    //as above: abSc indices r only referenced, every task copies them before sorting
+    std::vector<readGroup> groups;
+    rawData.get_ab_sc_groups(groups, thread);
+    ProgressReporter progress([&abScCount]{return abScCount.total();}, groups.size());
+
+    //giant groups would set the runtime of the whole step on one thread: they r collapsed first, one after the other with all threads
+    std::vector<readGroup> abScReads;
+    std::vector<readGroup> giantAbScReads;
+    abScReads.reserve(groups.size());
+    for(const readGroup& group : groups)
+    {
+        if(thread > 1 && parallelGroupMinReads > 0 && group.size() >= parallelGroupMinReads)
+        {
+            giantAbScReads.push_back(group);
+        }
+        else
+        {
+            abScReads.push_back(group);
+        }
+    }
+    //the threads of the executor search the neighbours of the giant groups and then collapse the other groups
+    WorkStealingExecutor executor(thread);
+    for(const readGroup& giantGroup : giantAbScReads)
+    {
+        count_abs_per_single_cell(umiMismatches, giantGroup, abScCount, &executor);
+    }
+    //collapsing the UMIs of a group grows with the square of the group size (for groups compared pairwise)
+    executor.run(abScReads.size(),
+                 [&](const size_t& i){count_abs_per_single_cell(umiMismatches, abScReads[i], abScCount);},
+                 [&](const size_t& i){return((unsigned long long)abScReads[i].size() * abScReads[i].size());});
+    progress.stop();
+    record_memory("collapse");
+    runReport.end_stage("collapse", rawData.getDataLines().size());
+}
+
+void BarcodeProcessingHandler::store_read(const char* umi, std::string& ab, const scKey& singleCell, std::string& treatment,
+                                          const unsigned long long& readCount)
+{
+    if(!umiSpillFiles.empty())
+    {
+        spill_read(umi, ab.c_str(), singleCell, treatment.c_str(), readCount);
+        return;
+    }
+
+    if(umi[0] == '\0')
+    {
+        //otherwise add reads directly to dict of ScAb to reads
+        rawData.add_to_scAbDict(umi, ab, singleCell, treatment, readCount);
+    }
+    else
+    {
+        rawData.add_to_umiDict(umi, ab, singleCell, treatment, readCount);
+    }
+
+    if(spillTotalReads > 0 && rawData.getDataLines().size() >= spillSampleReads){start_spilling();}
+}
+
+void BarcodeProcessingHandler::spill_read(const char* umi, const char* ab, const scKey& singleCell, const char* treatment,
+                                          const unsigned long long& readCount)
+{
+    //reads without UMI r not checked in step 2 and go directly to the partition of their single cell
+    if(umi[0] == '\0')
+    {
+        spill_processed_read(umi, ab, singleCell, treatment, nullptr, 0, 0, readCount);
+    }
+    else
+    {
+        std::ofstream& file = *umiSpillFiles.at(std::hash<std::string_view>()(umi) % umiSpillFiles.size());
+        file << umi << "\t" << ab << "\t" << singleCell << "\t" << treatment << "\t" << readCount << "\n";
+    }
+}
+
+void BarcodeProcessingHandler::spill_processed_read(const char* umi, const char* ab, const scKey& singleCell, const char* treatment,
+                                                    const char* cellClass, const unsigned long long& umiCount, const unsigned long long& umiReads,
+                                                    const unsigned long long& readCount)
+{
+    //partition by the hash of the single cell (mixed, bcs the single cell index is a dense integer)
+    std::ofstream& file = *cellSpillFiles.at(((singleCell * 0x9E3779B97F4A7C15ULL) >> 32) % cellSpillFiles.size());
+    file << umi << "\t" << ab << "\t" << singleCell << "\t" << treatment << "\t" << (cellClass == nullptr ? "" : cellClass) << "\t" 
+         << umiCount << "\t" << umiReads << "\t" << readCount << "\n";
+}
+
+std::string BarcodeProcessingHandler::spill_file_name(const std::string& type, const unsigned int& partition) const
+{
+    return(spillPrefix + "_" + type + "Partition_" + std::to_string(partition) + ".tsv");
+}
+
+unsigned long long BarcodeProcessingHandler::raw_data_bytes() const
+{
+    unsigned long long bytes = 0;
+    rawData.for_each_memory_usage([&](const std::string&, const memoryUsage& usage){bytes += usage.bytes;});
+    return bytes;
+}
+
+void BarcodeProcessingHandler::start_sample(const unsigned long long& totalReads)
+{
+    spillTotalReads = totalReads;
+    spillBaseBytes = raw_data_bytes();
+}
+
+void BarcodeProcessingHandler::start_spilling()
+{
+    //memory per read measured on the sample: arena lines, dict entries and unique strings
+    //(the memory of the later processing steps is not included, the partitions hold the parsed reads within the budget)
+    const dataLineArena& sampleLines = rawData.getDataLines();
+    const unsigned long long bytes = raw_data_bytes();
+    const unsigned long long sampleBytes = bytes - std::min(bytes, spillBaseBytes);
+    const double bytesPerRead = (sampleLines.size() == 0) ? 0 : double(sampleBytes) / sampleLines.size();
+    //a partition holds at least one read (for small files the measured memory includes whole arena chunks)
+    unsigned int partitions = std::max(1.0, std::ceil(spillTotalReads * bytesPerRead / (maxMemory * 1e9)));
+    partitions = std::min<unsigned long long>(partitions, std::max(1ULL, spillTotalReads));
+    std::cout << "Processing reads out of core in " << partitions << " partitions (" << (unsigned long long)bytesPerRead 
+              << " bytes per read, spill files: " << spillPrefix << "_*)\n";
+    runReport.set_counter("outOfCoreBytesPerRead", bytesPerRead);
+    runReport.set_counter("outOfCorePartitions", partitions);
+    spillTotalReads = 0;
+
+    for(unsigned int partition = 0; partition < partitions; ++partition)
+    {
+        umiSpillFiles.push_back(std::make_unique<std::ofstream>(spill_file_name("umi", partition)));
+        cellSpillFiles.push_back(std::make_unique<std::ofstream>(spill_file_name("cell", partition)));
+        if(!umiSpillFiles.back()->is_open() || !cellSpillFiles.back()->is_open())
+        {
+            std::cerr << "Could not create spill file " << spill_file_name("umi", partition) << " for out of core processing\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //copy the sample into the partitions, it stays in rawData until the first partition is loaded
+    //(the class counts of guide reads parsed so far point into its UniqueCharSet)
+    for(size_t line = 0; line < sampleLines.size(); ++line)
+    {
+        spill_read(sampleLines.umi_seq(line), sampleLines.ab_name(line), sampleLines.scID[line], sampleLines.treatment_name(line),
+                   sampleLines.readCount[line]);
+    }
+}
+
+void BarcodeProcessingHandler::close_spill_file(std::ofstream& file, const std::string& fileName) const
+{
+    file.flush();
+    if(!file.fail()){file.close();}
+    if(file.fail())
+    {
+        std::cerr << "ERROR: Could not write spill file " << fileName << " for out of core processing (disk full?)\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+void BarcodeProcessingHandler::processBarcodeMappingOutOfCore(const int& umiMismatches, const int& thread, const std::string& output)
+{
+    const unsigned int partitions = umiSpillFiles.size();
+    for(unsigned int partition = 0; partition < partitions; ++partition)
+    {
+        close_spill_file(*umiSpillFiles[partition], spill_file_name("umi", partition));
+    }
+
+    //step 2 for every UMI partition (all reads of a UMI r in the same partition), the kept reads r spilled by single cell
+    std::string line;
+    for(unsigned int partition = 0; partition < partitions; ++partition)
+    {
+        std::cout << "PARTITION[" << partition + 1 << "/" << partitions << "] of UMIs\n";
+        rawData.clear_reads();
+        const std::string fileName = spill_file_name("umi", partition);
+        std::ifstream file(fileName);
+        std::vector<std::string> fields;
+        while(std::getline(file, line))
+        {
+            fields = splitByDelimiter(line, "\t");
+            rawData.add_to_umiDict(fields.at(0).c_str(), fields.at(1), std::stoull(fields.at(2)), fields.at(3), std::stoull(fields.at(4)));
+        }
+        file.close();
+        std::remove(fileName.c_str());
+
+        remove_reads_of_non_unique_umis(thread);
 
-    const std::shared_ptr< std::unordered_map<const char*, std::vector<dataLinePtr>, CharHash, CharPtrComparator>> AbScMap = rawData.getUniqueAbSc();
-    for(std::unordered_map<const char*, std::vector<dataLinePtr>, CharHash, CharPtrComparator>::const_iterator it = AbScMap->begin(); 
-        it != AbScMap->end(); 
-        it++)
+        //the kept read of an AB-SC of every UMI has the number of reads for this AB-SC
+        const dataLineArena& lines = rawData.getDataLines();
+        for(size_t keptLine = 0; keptLine < lines.size(); ++keptLine)
+        {
+            if(lines.umiCount[keptLine] == 0){continue;}
+            spill_processed_read(lines.umi_seq(keptLine), lines.ab_name(keptLine), lines.scID[keptLine], lines.treatment_name(keptLine),
+                                 lines.cell_classname(keptLine), lines.umiCount[keptLine], lines.umiReads[keptLine], lines.readCount[keptLine]);
+        }
+    }
+    umiSpillFiles.clear();
+    for(unsigned int partition = 0; partition < partitions; ++partition)
     {
-        //as above: abSc is copied only
-        boost::asio::post(pool_3, std::bind(&BarcodeProcessingHandler::count_abs_per_single_cell, this, 
-                                          std::ref(umiMismatches), std::cref(it->second), 
-                                          std::ref(umiCount), std::cref(totalCount), std::ref(uniqueUmiMap) ));
+        close_spill_file(*cellSpillFiles[partition], spill_file_name("cell", partition));
     }
-    pool_3.join();
-    printProgress(1);
-    std::cout << "\n";
 
+    //step 3 for every single cell partition (all reads of an AB-SC r in the same partition), the counts r appended to the output
+    std::ofstream umiOutputFile;
+    std::ofstream abOutputFile;
+    open_count_files(output, umiOutputFile, abOutputFile);
+    for(unsigned int partition = 0; partition < partitions; ++partition)
+    {
+        std::cout << "PARTITION[" << partition + 1 << "/" << partitions << "] of single cells\n";
+        rawData.clear_reads();
+        const std::string fileName = spill_file_name("cell", partition);
+        std::ifstream file(fileName);
+        std::vector<std::string> fields;
+        while(std::getline(file, line))
+        {
+            fields = splitByDelimiter(line, "\t"); //keeps empty fields (e.g. no class)
+            rawData.add_processed_line(fields.at(0), fields.at(1), std::stoull(fields.at(2)), fields.at(3), fields.at(4),
+                                       std::stoull(fields.at(5)), std::stoull(fields.at(6)), std::stoull(fields.at(7)));
+        }
+        file.close();
+        std::remove(fileName.c_str());
+
+        count_abs_of_kept_reads(umiMismatches, thread);
+        write_counts(umiOutputFile, abOutputFile);
+        result.clear_counts();
+    }
+    cellSpillFiles.clear();
+    umiOutputFile.close();
+    abOutputFile.close();
 }
 
-bool BarcodeProcessingHandler::checkIfLineIsDeleted(const dataLinePtr& line, const std::vector<dataLinePtr>& dataLinesToDelete)
+bool BarcodeProcessingHandler::checkIfLineIsDeleted(const dataLineIdx& line, const std::vector<dataLineIdx>& dataLinesToDelete)
 {
     if(std::find(dataLinesToDelete.begin(), dataLinesToDelete.end(),line) != dataLinesToDelete.end())
     {
@@ -845,6 +1041,8 @@ bool BarcodeProcessingHandler::checkIfLineIsDeleted(const dataLinePtr& line, con
 
 void BarcodeProcessingHandler::writeLog(std::string output)
 {
+    runReport.start_stage("output");
+    TRACE_SPAN("io", "write log");
     //WRITE INTO FILE
     std::ofstream outputFile;
     std::size_t found = output.find_last_of("/");
@@ -858,23 +1056,33 @@ void BarcodeProcessingHandler::writeLog(std::string output)
     }
     outputFile.open (output);
 
-    outputFile << "TOTAL READS:\t" << result.get_log_data().totalReads << "\n";
-    outputFile << "TOTAL GUIDE-READS:\t" << result.get_log_data().totalGuideReads << "\n";
-    outputFile << "TOTAL AB-READS:\t" << result.get_log_data().totalAbReads << "\n";
+    const ProcessingLog logData = result.get_log_data();
+    outputFile << "TOTAL READS:\t" << logData.totalReads << "\n";
+    outputFile << "TOTAL GUIDE-READS:\t" << logData.totalGuideReads << "\n";
+    outputFile << "TOTAL AB-READS:\t" << logData.totalAbReads << "\n";
 
-    outputFile << "REMOVED READS because UMI was not unique(>=90% reads are from same AB/SC):\t" << result.get_log_data().removedUmiReads << "\n";
-    outputFile << "REMOVED READS because the single cell had no mapped CLASS:\t" << result.get_log_data().removedClassReads << "\n";
+    outputFile << "REMOVED READS because UMI was not unique(>=90% reads are from same AB/SC):\t" << logData.removedUmiReads << "\n";
+    outputFile << "REMOVED READS because the single cell had no mapped CLASS:\t" << logData.removedClassReads << "\n";
 
-    outputFile << "UMI MM:\t" << result.get_log_data().umiMM << "\n";
-    outputFile << "Lost SINGLECELL->CLASS mappings because guide reads for single cell were not unique(>=90% reads for same CLASS):\t" << result.get_log_data().removedClasses << "\n";
+    outputFile << "UMI MM:\t" << logData.umiMM << "\n";
+    outputFile << "Lost SINGLECELL->CLASS mappings because guide reads for single cell were not unique(>=90% reads for same CLASS):\t" << logData.removedClasses << "\n";
 
     outputFile.close();
-
+    runReport.end_stage("output");
 }
 
 void BarcodeProcessingHandler::writeAbCountsPerSc(const std::string& output)
 {
-    std::ofstream outputFile;
+    std::ofstream umiOutputFile;
+    std::ofstream abOutputFile;
+    open_count_files(output, umiOutputFile, abOutputFile);
+    write_counts(umiOutputFile, abOutputFile);
+    umiOutputFile.close();
+    abOutputFile.close();
+}
+
+void BarcodeProcessingHandler::open_count_files(const std::string& output, std::ofstream& umiOutputFile, std::ofstream& abOutputFile)
+{
     std::size_t found = output.find_last_of("/");
 
     //STORE RAW UMI CORRECTED DATA
@@ -887,13 +1095,8 @@ void BarcodeProcessingHandler::writeAbCountsPerSc(const std::string& output)
     {
         umiOutput = output.substr(0,found) + "/" + "UMI" + output.substr(found+1);
     }
-    outputFile.open (umiOutput);
-    outputFile << "UMI" << "\t" << "AB" << "\t" << "SingleCell_ID" << "\t" << "TREATMENT" << "\t" << "UMI_COUNT" << "\n"; 
-    for(umiCount line : result.get_umi_data())
-    {
-        outputFile << line.umi << "\t" << line.abName << "\t" << line.scID << "\t" << line.treatment << "\t" << line.abCount << "\n"; 
-    }
-    outputFile.close();
+    umiOutputFile.open (umiOutput);
+    umiOutputFile << "UMI" << "\t" << "AB" << "\t" << "SingleCell_ID" << "\t" << "TREATMENT" << "\t" << "UMI_COUNT" << "\n"; 
 
     //STORE AB COUNT DATA
     std::string abOutput = output;
@@ -905,27 +1108,75 @@ void BarcodeProcessingHandler::writeAbCountsPerSc(const std::string& output)
     {
         abOutput = output.substr(0,found) + "/" + "AB" + output.substr(found+1);
     }
-    outputFile.open (abOutput);
-    bool writeClassLabels = rawData.check_class();
-    if(writeClassLabels)
+    abOutputFile.open (abOutput);
+    if(rawData.check_class())
     {
-        outputFile << "AB_BARCODE" << "\t" << "SingleCell_BARCODE" << "\t" << "AB_COUNT" << "\t" << "TREATMENT" << "\t" << "CLASS" << "\t" << "CLASS_COUNT" <<"\n"; 
+        abOutputFile << "AB_BARCODE" << "\t" << "SingleCell_BARCODE" << "\t" << "AB_COUNT" << "\t" << "TREATMENT" << "\t" << "CLASS" << "\t" << "CLASS_COUNT" <<"\n"; 
     }
     else
     {
-        outputFile << "AB_BARCODE" << "\t" << "SingleCell_BARCODE" << "\t" << "AB_COUNT" << "\t" << "TREATMENT" << "\n"; 
+        abOutputFile << "AB_BARCODE" << "\t" << "SingleCell_BARCODE" << "\t" << "AB_COUNT" << "\t" << "TREATMENT" << "\n"; 
     }
+}
+
+void BarcodeProcessingHandler::write_counts(std::ofstream& umiOutputFile, std::ofstream& abOutputFile)
+{
+    runReport.start_stage("output");
+    TRACE_SPAN("io", "write counts");
+    result.for_each_umi_count([&](const umiCount& line)
+    {
+        umiOutputFile << line.umi << "\t" << line.abName << "\t" << singleCellIndexToName(line.scID, varyingBarcodesPos) << "\t" << line.treatment << "\t" << line.abCount << "\n"; 
+    });
 
-    for(scAbCount line : result.get_ab_data())
+    bool writeClassLabels = rawData.check_class();
+    result.for_each_ab_count([&](const scAbCount& line)
     {
         if(writeClassLabels)
         {
-                outputFile << line.abName << "\t" << line.scID << "\t" << line.abCount << "\t" << line.treatment << "\t" << line.className << "\t" << guideCountPerSC.at(line.scID) << "\n"; 
+                abOutputFile << line.abName << "\t" << singleCellIndexToName(line.scID, varyingBarcodesPos) << "\t" << line.abCount << "\t" << line.treatment << "\t" << line.className << "\t" << guideCountPerSC.at(line.scID) << "\n"; 
         }
         else
         {
-                outputFile << line.abName << "\t" << line.scID << "\t" << line.abCount << "\t" << line.treatment << "\n"; 
+                abOutputFile << line.abName << "\t" << singleCellIndexToName(line.scID, varyingBarcodesPos) << "\t" << line.abCount << "\t" << line.treatment << "\n"; 
+        }
+    });
+    record_memory("output");
+    runReport.end_stage("output");
+}
+
+void BarcodeProcessingHandler::record_memory(const std::string& stage,
+                                             const std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict)
+{
+    rawData.for_each_memory_usage([&](const std::string& structure, const memoryUsage& usage)
+    {
+        runReport.record_memory(stage, structure, usage.bytes, usage.objects);
+    });
+    const memoryUsage resultUsage = result.memory_usage();
+    runReport.record_memory(stage, "Results", resultUsage.bytes, resultUsage.objects);
+
+    //the class counts only exist while guide reads r parsed, objects r the UMIs of all classes in all cells
+    if(scClasseCountDict != nullptr)
+    {
+        memoryUsage classCounts;
+        classCounts.bytes = hash_table_bytes(*scClasseCountDict);
+        for(const std::pair<const scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>& cell : *scClasseCountDict)
+        {
+            classCounts.bytes += hash_table_bytes(cell.second);
+            for(const std::pair<const char* const, UnorderedSetCharPtr>& cellClass : cell.second)
+            {
+                classCounts.bytes += hash_table_bytes(cellClass.second);
+                classCounts.objects += cellClass.second.size();
+            }
         }
+        runReport.record_memory(stage, "scClasseCountDict", classCounts.bytes, classCounts.objects);
     }
-    outputFile.close();
+}
+
+void BarcodeProcessingHandler::writeRunReport(const std::string& output, const std::vector<std::string>& outputPrefixes)
+{
+    for(const std::string& fileName : parsedFiles){runReport.add_input_file(fileName);}
+    for(const std::string& prefix : outputPrefixes){runReport.add_output_file(RunReport::output_file(output, prefix));}
+    runReport.set_total_reads(result.get_log_data().totalReads);
+    runReport.write(output);
+    TRACE_WRITE(output);
 }
@@ -20,6 +20,9 @@
 #include <cmath>
 
 #include "DemultiplexedData.hpp"
+#include "UmiClustering.hpp"
+#include "WorkStealingExecutor.hpp"
+#include "RunReport.hpp"
 #include "helper.hpp"
 
 /**
@@ -36,6 +39,8 @@ struct NBarcodeInformation
     // map of barcode to id, maps are in order of their occurence in the fastqRead
     // ids of the CI barcode within the barcode file (includes only barcodes for variable sequence regions)
     std::vector<std::unordered_map<std::string, int> > barcodeIdDict; //used to generate a SC-index
+    //number of possible ids in each CI barcoding round (the base of this digit in the mixed radix single cell index)
+    std::vector<scKey> barcodeIdRadix;
     
     //different indices, they r the index of the NNN-barcodes only (and therefore differe from the index of all barcodes incl. constant ones)
     std::vector<int> NBarcodeIndices; //CI barcode indices
@@ -50,8 +55,9 @@ struct scAbCount
     const char* treatment;
     const char* className;
 
-    const char* scID;
-    int abCount = 0;
+    scKey scID;
+    //number of UMIs (or of reads for ABs without UMI, summed over the COUNT of collapsed lines)
+    unsigned long long abCount = 0;
 }; 
 
 //data type representing counts per unique UMI in final processed data (without collapsed UMIs)
@@ -61,8 +67,9 @@ struct umiCount
     const char* abName;
     const char* treatment;
     
-    const char* scID;
-    int abCount = 0;
+    scKey scID;
+    //number of reads of the collapsed UMI (umiCluster::readCount)
+    unsigned long long abCount = 0;
 }; 
 
 //some information about the read/ UMI quality (how many reads removed, how many Mismatches, etc.)
@@ -93,62 +100,90 @@ struct ProcessingLog
  *        the umiData = final UMI count data (same data as above but not UMI collapsed)
  *        the logData = basic values for number of removed reads due to mismatches, non-unique UMIs, etc.
  * 
- *        All the values are thread safe.
+ *        All the values are thread safe: every thread of the processing pool adds to its own buffer (no locking),
+ *        the buffers of all threads r only read after the pool is joined.
  */
 class Results
 {
     public:
         //getter functions (assume we only get those value AFTER they are completely filled -> no locking at this point)
-        const std::vector<scAbCount> get_ab_data() const
+        //the data is not copied, func is called for every line of all thread buffers
+        template<typename Func>
+        void for_each_ab_count(Func func) const
         {
-            return(abData);
+            threadResults.for_each([&func](const threadResult& data)
+            {
+                for(const scAbCount& line : data.abData){func(line);}
+            });
         }
-        const std::vector<umiCount> get_umi_data() const
+        template<typename Func>
+        void for_each_umi_count(Func func) const
         {
-            return(umiData);
+            threadResults.for_each([&func](const threadResult& data)
+            {
+                for(const umiCount& line : data.umiData){func(line);}
+            });
         }
         const ProcessingLog get_log_data() const
         {
-            return(logData);
+            ProcessingLog log = logData;
+            threadResults.for_each([&log](const threadResult& data)
+            {
+                ullong_save_add(log.umiMM, data.umiMM);
+                ullong_save_add(log.removedUmiReads, data.removedUmiReads);
+                ullong_save_add(log.removedClassReads, data.removedClassReads);
+                log.removedClasses += data.removedClasses;
+            });
+            return(log);
         }
 
-        //setter functions, all locked for manipulation by threads
+        //bytes of the AB and UMI counts of all threads, objects r the count lines
+        memoryUsage memory_usage() const
+        {
+            memoryUsage usage;
+            threadResults.for_each([&usage](const threadResult& data)
+            {
+                usage.bytes += sizeof(threadResult) + vector_bytes(data.umiData) + vector_bytes(data.abData);
+                usage.objects += data.umiData.size() + data.abData.size();
+            });
+            return(usage);
+        }
+
+        //setter functions, the buffer of the calling thread is filled
         void add_ab_count(const scAbCount& abCount)
         {
-            abLock.lock();
-            abData.push_back(abCount);
-            abLock.unlock();
+            threadResults.local().abData.push_back(abCount);
         }
         void add_umi_count(const umiCount& umiCount)
         {
-            umiLock.lock();
-            umiData.push_back(umiCount);
-            umiLock.unlock();
+            threadResults.local().umiData.push_back(umiCount);
         }
         void add_umi_mismatches(const unsigned long long& mm)
         {
-            logLock.lock();
-            ullong_save_add(logData.umiMM, mm);
-            logLock.unlock();
+            ullong_save_add(threadResults.local().umiMM, mm);
         }
         void add_removed_reads_umi(const unsigned long long& reads)
         {
-            logLock.lock();
-            ullong_save_add(logData.removedUmiReads, reads);
-            logLock.unlock();
+            ullong_save_add(threadResults.local().removedUmiReads, reads);
         }
         void add_removed_reads_class(const unsigned long long& reads)
         {
-            logLock.lock();
-            ullong_save_add(logData.removedClassReads, reads);
-            logLock.unlock();
+            ullong_save_add(threadResults.local().removedClassReads, reads);
         }
         void add_removed_class_for_single_cell()
         {
-            logLock.lock();
-            ++logData.removedClasses;
-            logLock.unlock();
+            ++threadResults.local().removedClasses;
         }
+        //remove the AB and UMI counts after they were written (e.g. after every partition of out of core processing), the log is kept
+        void clear_counts()
+        {
+            threadResults.for_each([](threadResult& data)
+            {
+                std::vector<umiCount>().swap(data.umiData);
+                std::vector<scAbCount>().swap(data.abData);
+            });
+        }
+        //the totals r only set once per parsed file (locked, files might be parsed in parallel)
         void set_total_reads(const unsigned long long& totalReads)
         {
             logLock.lock();
@@ -169,15 +204,23 @@ class Results
         }
 
     private:
-        //holding the counts per unique UMI (just for quality checks)
-        std::vector<umiCount> umiData;
-        //final data structures storing scID, AB-name, treatment-name and AB-count
-        std::vector<scAbCount> abData;
-        //statistics of the whole process
+        //results of one thread
+        struct threadResult
+        {
+            //holding the counts per unique UMI (just for quality checks)
+            std::vector<umiCount> umiData;
+            //final data structures storing scID, AB-name, treatment-name and AB-count
+            std::vector<scAbCount> abData;
+            //removed reads/ mismatches of this thread, summed up into the ProcessingLog
+            unsigned long long umiMM = 0;
+            unsigned long long removedUmiReads = 0;
+            unsigned long long removedClassReads = 0;
+            uint removedClasses = 0;
+        };
+        ThreadLocalShards<threadResult> threadResults;
+        //statistics of the whole process (totals)
         ProcessingLog logData;
 
-        std::mutex umiLock;
-        std::mutex abLock;
         std::mutex logLock;
 };
 
@@ -191,6 +234,13 @@ void generateBarcodeDicts(std::string barcodeFile, std::string barcodeIndices,
                           std::vector<std::string>& proteinDict, const int& protIdx, 
                           std::vector<std::string>* treatmentDict = nullptr, const int& treatmentIdx = 0);
 
+/**
+ * @brief Convert the mixed radix single cell index back into the ids of the CI-barcodes (one for each barcoding round)
+ *        or into the dot seperated name of the cell that is written to the output (e.g. 12.3.88)
+ */
+void singleCellIndexToBarcodeIds(scKey scIdx, const NBarcodeInformation& barcodeIdData, std::vector<int>& barcodeIds);
+std::string singleCellIndexToName(const scKey& scIdx, const NBarcodeInformation& barcodeIdData);
+
 /**
  * @brief A class to handle the processing of the demultiplexed data. 
  * This involves:
@@ -224,9 +274,23 @@ class BarcodeProcessingHandler
         //2.) retain only reads for SC where reads have more than 90% same treatment
         //3.) collapse same UMI reads with correcting mismatches in UMI for default 2 mismatches
         void processBarcodeMapping(const int& umiMismatches, const int& thread);
+        //same as processBarcodeMapping followed by writeAbCountsPerSc for reads that were spilled to disk while parsing (see setMaxMemory):
+        //step 2 runs for every partition of UMIs, step 3 for every partition of single cells and the counts r appended to the output
+        void processBarcodeMappingOutOfCore(const int& umiMismatches, const int& thread, const std::string& output);
+        bool isOutOfCore() const
+        {
+            return(maxMemory > 0);
+        }
 
         void writeLog(std::string output);
         void writeAbCountsPerSc(const std::string& output);
+        //timing of the stages (parse, UMI filter, collapse, output), the tool is set by the caller that also times its own stages
+        RunReport& getRunReport()
+        {
+            return runReport;
+        }
+        //writes the run report with the parsed files and the output files (output with one of the prefixes) next to the output
+        void writeRunReport(const std::string& output, const std::vector<std::string>& outputPrefixes = {"AB", "UMI", "LOG"});
 
         inline void addTreatmentData(std::unordered_map<std::string, std::string > map)
         {
@@ -260,10 +324,38 @@ class BarcodeProcessingHandler
         {
             return(treatmentIdx);
         }
+        const NBarcodeInformation& getBarcodeInformation() const
+        {
+            return(varyingBarcodesPos);
+        }
         void setUmiFilterThreshold(double threshold)
         {
             umiFilterThreshold = threshold;
         }
+        void setUmiClusteringMode(const UmiClusteringMode& mode)
+        {
+            umiClusteringMode = mode;
+        }
+        void setUmiDistance(const UmiDistance& distance)
+        {
+            umiDistance = distance;
+        }
+        //must be set before parsing the reads
+        void setReadGrouping(const ReadGrouping& grouping)
+        {
+            rawData.setReadGrouping(grouping);
+        }
+        //process reads out of core: if all reads would need more than maxMemory GB they r partitioned into several spill files
+        //(spillPrefix_*), must be set before parsing the reads
+        void setMaxMemory(const double& maxMemoryGb, const std::string& spillFilePrefix)
+        {
+            maxMemory = maxMemoryGb;
+            spillPrefix = spillFilePrefix;
+        }
+        void setParallelGroupSize(const size_t& groupSize)
+        {
+            parallelGroupMinReads = groupSize;
+        }
         void setScClassConstaint(bool scMustHaveClass)
         {
             scMustHaveClass = scMustHaveClass;
@@ -272,69 +364,85 @@ class BarcodeProcessingHandler
     private:
 
         //parse the file, store each line in UnprocessedDemultiplexedData structure (ABs, treatment is already stored as a name,
-        // single cells are defined by a dot seperated list of indices)
-        void add_line_to_temporary_data(const std::string& line, const int& elements,
-                                        std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict,
+        // single cells are defined by a dot seperated list of indices), returns the number of reads of the line (COUNT of collapsed files)
+        unsigned long long add_line_to_temporary_data(const std::string& line, const int& elements,
+                                        std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict,
                                         unsigned long long& abReadCount, unsigned long long& guideReadCount);
         void parseBarcodeLines(std::istream* instream, const unsigned long long& totalReads, unsigned long long& currentReads,
-                               std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict);
+                               std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict);
         
         //a couple of overloaded frunctions to read AB and guide demultiplexed lines seperately (ToDo: delete old function taking also ONE file with both data)
-        void add_line_to_temporary_data(const std::string& line, const int& elements,
-                                   std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict,
+        unsigned long long add_line_to_temporary_data(const std::string& line, const int& elements,
+                                   std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict,
                                    unsigned long long& abReadCount, unsigned long long& guideReadCount);
         void parse_barcode_lines_seperately(std::istream* instream, const unsigned long long& totalReads, unsigned long long& currentReads, 
-                          std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict);
+                          std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict);
         void parse_file_seperately(const std::string fileName, const int& thread, 
-                  std::unordered_map< const char*, std::unordered_map< const char*, 
+                  std::unordered_map< scKey, std::unordered_map< const char*, 
                   UnorderedSetCharPtr>>* scClasseCountDict);
 
         //check if a read is in 'dataLinesToDelete' (not-unique UMI for this read)
-        bool checkIfLineIsDeleted(const dataLinePtr& line, const std::vector<dataLinePtr>& dataLinesToDelete);
+        bool checkIfLineIsDeleted(const dataLineIdx& line, const std::vector<dataLineIdx>& dataLinesToDelete);
         //stores a real unique read in a dict for the corresponding AB-SC (only read with UMI presence > 90 considered)
         //reads r collapsed
-        void markReadsWithNoUniqueUmi(const std::vector<umiDataLinePtr>& uniqueUmis,
-                                      std::atomic<unsigned long long>& count,
-                                      const unsigned long long& totalCount);
-        void markReadsWithNoUniqueTreatment(const std::vector<dataLinePtr>& uniqueSc,
-                                                              std::vector<dataLinePtr>& dataLinesToDelete, 
-                                                              std::atomic<unsigned long long>& count,
-                                                              const unsigned long long& totalCount);
-        //used within 'count_abs_per_single_cell' to get counts per UMI for reads of one AB SC combination
-        void count_umi_occurence(std::vector<int>& positionsOfSameUmi, 
-                                                   umiCount& umiLineTmp,
-                                                   const std::vector<dataLinePtr>& allScAbCounts,
-                                                   const int& umiMismatches,
-                                                   const int& lastIdx);
+        void markReadsWithNoUniqueUmi(const readGroup& uniqueUmis,
+                                      ThreadCounter& count);
+        void markReadsWithNoUniqueTreatment(const std::vector<dataLineIdx>& uniqueSc,
+                                                              std::vector<dataLineIdx>& dataLinesToDelete, 
+                                                              ThreadCounter& count);
         //count the ABs per single cell (iterating over reads for a AB-SC combination and summing them, this is already a sparse vector)
         //reads of same UMI are collapsed before
-        void count_abs_per_single_cell(const int& umiMismatches, const std::vector<dataLinePtr>& uniqueAbSc,
-                                                        std::atomic<unsigned long long>& count,
-                                                        const unsigned long long& totalCount,
-                                                        std::shared_ptr<std::unordered_map<const char*, std::vector<umiDataLinePtr>, 
-                    CharHash, CharPtrComparator>>& umiMap);
+        void count_abs_per_single_cell(const int& umiMismatches, const readGroup& uniqueAbSc,
+                                                        ThreadCounter& count,
+                                                        WorkStealingExecutor* groupExecutor = nullptr);
+
+        //the two processing steps on all reads in rawData: 2.) remove reads of UMIs that r not unique for an AB-SC 3.) collapse UMIs and count ABs
+        void remove_reads_of_non_unique_umis(const int& thread);
+        void count_abs_of_kept_reads(const int& umiMismatches, const int& thread);
+
+        //store a parsed read in rawData, or in its spill file when processing out of core
+        void store_read(const char* umi, std::string& ab, const scKey& singleCell, std::string& treatment, const unsigned long long& readCount);
+        //out of core processing: reads with UMI r partitioned by UMI (all reads of a UMI in one file), 
+        //reads after step 2 (or without UMI) by single cell. The first reads r parsed into memory as a sample,
+        //start_spilling measures their memory, opens the partitions and moves the sample into them
+        void start_sample(const unsigned long long& totalReads);
+        void start_spilling();
+        unsigned long long raw_data_bytes() const;
+        void spill_read(const char* umi, const char* ab, const scKey& singleCell, const char* treatment, const unsigned long long& readCount);
+        void spill_processed_read(const char* umi, const char* ab, const scKey& singleCell, const char* treatment,
+                                  const char* cellClass, const unsigned long long& umiCount, const unsigned long long& umiReads,
+                                  const unsigned long long& readCount);
+        std::string spill_file_name(const std::string& type, const unsigned int& partition) const;
+        //exits if a write to the spill file failed (e.g. full disk), the partition would be truncated
+        void close_spill_file(std::ofstream& file, const std::string& fileName) const;
+
+        //write AB and UMI counts of result (headers r written when opening the files)
+        void open_count_files(const std::string& output, std::ofstream& umiOutputFile, std::ofstream& abOutputFile);
+        void write_counts(std::ofstream& umiOutputFile, std::ofstream& abOutputFile);
 
         //get positions of all barcodes in the lines of demultiplexed data
         void getBarcodePositions(const std::string& line, int& barcodeElements);
 
-        //map all the barcodes of CI to a unique 'number' string as SingleCellIdx
-        std::string generateSingleCellIndexFromBarcodes(std::vector<std::string> ciBarcodes);
+        //map all the barcodes of CI (at the positions fastqReadBarcodeIdx of a line) to a unique mixed radix number as SingleCellIdx
+        scKey generateSingleCellIndexFromBarcodes(const std::vector<std::string>& barcodes);
+
+        //add the memory of all data structures (rawData, result and the class counts if given) to the run report of this stage
+        void record_memory(const std::string& stage,
+                           const std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>* scClasseCountDict = nullptr);
 
         //functions processing the class labels for single cells (obtained by guide reads)
-        void generate_unique_sc_to_class_dict(const std::unordered_map< const char*, 
+        void generate_unique_sc_to_class_dict(const std::unordered_map< scKey, 
                                               std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict);
 
-        void combine_ab_and_guide_data(std::vector<dataLine>& abDataLines,
-                                       const std::unordered_map< const char*, const char*>& scClassMap);
-
         //data structure storing lines with: UMI, AB_id, SingleCell_id
         //this is the raw data not UMI corrected
         UnprocessedDemultiplexedData rawData;
         // the final data: ABCounts, UMICounts, and a processingLog containing basic values (removed reads, etc.)
         Results result;
-        std::unordered_map< const char*, unsigned long long> guideCountPerSC;
+        std::unordered_map< scKey, unsigned long long> guideCountPerSC;
+        RunReport runReport;
+        std::vector<std::string> parsedFiles;
 
-        std::mutex statusUpdateLock;  
         std::mutex writeToRawDataLock; //while processing reads of same UMI, we write UMI collapsed reads into the dict
         //for reads of same AB/SC and have to lock writing
 
@@ -346,8 +454,24 @@ class BarcodeProcessingHandler
         int abIdx = INT_MAX;
         std::vector<int> umiIdx;
         int treatmentIdx = INT_MAX;
+        int countIdx = INT_MAX; // COUNT column of collapsed demultiplexed files (number of identical reads of a line)
         int umiLength = 0;
 
         double umiFilterThreshold = 0.0;
         bool scMustHaveClass = true;
+        UmiClusteringMode umiClusteringMode = UmiClusteringMode::greedy;
+        UmiDistance umiDistance = UmiDistance::levenshtein;
+        //groups with at least this many UMIs r clustered with an index (deletion neighbourhood for levenshtein, pigeonhole for hamming)
+        size_t umiNeighbourhoodMinUmis = 64;
+        //groups with at least this many reads r collapsed one after the other, each one with all threads (0 = never)
+        size_t parallelGroupMinReads = 20000;
+
+        //out of core processing (maxMemory in GB, 0 = all reads in memory)
+        double maxMemory = 0;
+        std::string spillPrefix;
+        unsigned long long spillTotalReads = 0; // reads of the parsed file, set while the sample is parsed
+        unsigned long long spillBaseBytes = 0; // memory of rawData before the sample
+        unsigned long long spillSampleReads = 4 * (1 << 16); // whole chunks of the arena columns
+        std::vector<std::unique_ptr<std::ofstream>> umiSpillFiles;
+        std::vector<std::unique_ptr<std::ofstream>> cellSpillFiles;
 };
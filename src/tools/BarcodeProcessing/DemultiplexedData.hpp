@@ -4,68 +4,252 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <functional>
 
 #include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 
 #include "dataTypes.hpp"
+#include "RadixSort.hpp"
+
+//a single cell is stored as a mixed radix number of its CI-barcode ids (one digit per barcoding round),
+//the dot seperated name of a cell (e.g. 12.3.88) is only generated when writing the output
+typedef unsigned long long scKey;
+
+//key for all reads of an AB in a single cell (the AB name is a unique char from the UniqueCharSet)
+typedef std::pair<const char*, scKey> AbScKey;
+struct AbScKeyHash
+{
+    size_t operator()(const AbScKey& key) const
+    {
+        size_t hash = std::hash<const char*>()(key.first);
+        hash ^= std::hash<scKey>()(key.second) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+//index of a line in the dataLineArena: 32 bit indices are enough for ~4*10^9 reads,
+//compile with -DLARGE_READ_INDEX to address more reads
+#ifdef LARGE_READ_INDEX
+typedef uint64_t dataLineIdx;
+#else
+typedef uint32_t dataLineIdx;
+#endif
+
+//a read of a UMI with its AB-SC combination, sorting these groups all reads of the same AB-SC together
+//(in the order of their position in the vector of reads for this UMI)
+struct umiRead
+{
+    AbScKey key;
+    dataLineIdx position;
+
+    inline bool operator<(const umiRead& other) const
+    {
+        if(key.second != other.key.second){return key.second < other.key.second;}
+        if(key.first != other.key.first){return std::less<const char*>()(key.first, other.key.first);}
+        return position < other.position;
+    }
+};
+
+/**
+ * @brief A column of the dataLineArena. Elements are stored in chunks of fixed size, so growing the column
+ * never copies the elements stored so far (no temporary doubling of memory like for a growing std::vector).
+ * Elements r addressed by their row index.
+ */
+template<typename T>
+class ArenaColumn
+{
+    public:
+        void push_back(const T& value)
+        {
+            if((elements & chunkMask) == 0)
+            {
+                chunks.emplace_back(new T[chunkSize]);
+            }
+            chunks.back()[elements & chunkMask] = value;
+            ++elements;
+        }
+        inline T& operator[](const size_t& i)
+        {
+            return chunks[i >> chunkBits][i & chunkMask];
+        }
+        inline const T& operator[](const size_t& i) const
+        {
+            return chunks[i >> chunkBits][i & chunkMask];
+        }
+        inline size_t size() const
+        {
+            return elements;
+        }
+        unsigned long long memory_bytes() const
+        {
+            return(chunks.size() * chunkSize * sizeof(T) + vector_bytes(chunks));
+        }
+
+    private:
+        static const unsigned int chunkBits = 16;
+        static const size_t chunkSize = (size_t(1) << chunkBits);
+        static const size_t chunkMask = chunkSize - 1;
+
+        std::vector<std::unique_ptr<T[]>> chunks;
+        size_t elements = 0;
+};
 
 /**
- * @brief A line in the demultiplexed data.
- * Storing the UMI sequence, Antibody sequence, 
- * unique cell sequences (basically all barcode sequences added to each other) 
- * and a sequence for the treatment
+ * @brief All lines of the demultiplexed data, stored column wise.
+ * Storing for each line the UMI sequence, Antibody name, single cell index
+ * (mixed radix number of the CI barcodes) and the treatment name. All strings r stored as charHandle
+ * of the UniqueCharSet of the reads (4 instead of 8 bytes per string), umi_seq(line) etc. return the unique char.
+ * A line is only addressed by its row index, the dicts grouping the lines
+ * by UMI and AB/SC therefore store only a list of indices.
  */
-struct dataLine
+struct dataLineArena
 {
+    dataLineArena(const UniqueCharSet& uniqueChars) : uniqueChars(&uniqueChars){}
+
+    //handle of a string that is not set (e.g. the class of a line without class)
+    static constexpr charHandle noString = std::numeric_limits<charHandle>::max();
+
     //variables that r set directly
-    const char* umiSeq;
-    const char* abName;
-    const char* scID;
-    const char* treatmentName;
+    ArenaColumn<charHandle> umiSeq;
+    ArenaColumn<charHandle> abName;
+    ArenaColumn<scKey> scID;
+    ArenaColumn<charHandle> treatmentName;
+    //number of identical reads of the line (more than one for lines of a collapsed demultiplexed file)
+    ArenaColumn<uint32_t> readCount;
 
     //variables set later on
     //class name and umi count are set when removing non-unique UMI read and collapsing the umis
-    const char* cellClassname;
-    unsigned long long umiCount = 0;
+    ArenaColumn<charHandle> cellClassname;
+    //64bit: summed over all (collapsed) lines of a UMI they can exceed the 32bit readCount of one line
+    ArenaColumn<uint64_t> umiCount;
+    //number of all reads of the UMI (before removing reads of other AB-SC combinations)
+    ArenaColumn<uint64_t> umiReads;
+
+    dataLineIdx add_line(const charHandle& umi, const charHandle& ab, const scKey& sc, const charHandle& treatment, const unsigned long long& reads = 1)
+    {
+        if(umiSeq.size() >= std::numeric_limits<dataLineIdx>::max())
+        {
+            std::cerr << "ERROR: Too many reads to address with 32 bit indices, compile with -DLARGE_READ_INDEX\n";
+            exit(EXIT_FAILURE);
+        }
+        if(reads > std::numeric_limits<uint32_t>::max())
+        {
+            std::cerr << "ERROR: Too many identical reads in one line: " << reads << "\n";
+            exit(EXIT_FAILURE);
+        }
+        umiSeq.push_back(umi);
+        abName.push_back(ab);
+        scID.push_back(sc);
+        treatmentName.push_back(treatment);
+        readCount.push_back(reads);
+        cellClassname.push_back(noString);
+        umiCount.push_back(0);
+        umiReads.push_back(0);
+
+        return(umiSeq.size() - 1);
+    }
+    inline size_t size() const
+    {
+        return umiSeq.size();
+    }
+
+    //the unique chars of the string columns, the class of a line without class is nullptr
+    inline const char* umi_seq(const size_t& line) const
+    {
+        return uniqueChars->getChar(umiSeq[line]);
+    }
+    inline const char* ab_name(const size_t& line) const
+    {
+        return uniqueChars->getChar(abName[line]);
+    }
+    inline const char* treatment_name(const size_t& line) const
+    {
+        return uniqueChars->getChar(treatmentName[line]);
+    }
+    inline const char* cell_classname(const size_t& line) const
+    {
+        return (cellClassname[line] == noString) ? nullptr : uniqueChars->getChar(cellClassname[line]);
+    }
+
+    memoryUsage memory_usage() const
+    {
+        memoryUsage usage;
+        usage.bytes = umiSeq.memory_bytes() + abName.memory_bytes() + scID.memory_bytes() + treatmentName.memory_bytes() + readCount.memory_bytes() +
+                      cellClassname.memory_bytes() + umiCount.memory_bytes() + umiReads.memory_bytes();
+        usage.objects = size();
+        return(usage);
+    }
+
+    private:
+        const UniqueCharSet* uniqueChars;
+};
+typedef std::unordered_map<const char*, std::vector<dataLineIdx>, CharHash, CharPtrComparator> UmiReadDict;
+typedef std::unordered_map<AbScKey, std::vector<dataLineIdx>, AbScKeyHash> AbScReadDict;
+
+//the indices of a group of reads (all reads of a UMI, or all reads of an AB-SC) stored contiguously:
+//the vector of a dict or a run of sorted reads
+struct readGroup
+{
+    const dataLineIdx* first;
+    size_t count;
+
+    readGroup(const std::vector<dataLineIdx>& lines) : first(lines.data()), count(lines.size()){}
+    readGroup(const dataLineIdx* first, const size_t& count) : first(first), count(count){}
+
+    inline const dataLineIdx* begin() const{return first;}
+    inline const dataLineIdx* end() const{return first + count;}
+    inline size_t size() const{return count;}
+    inline const dataLineIdx& operator[](const size_t& i) const{return first[i];}
+    inline const dataLineIdx& front() const{return first[0];}
+    inline const dataLineIdx& back() const{return first[count - 1];}
+};
+
+//how reads r grouped by UMI and AB-SC: inserting them into hash maps while parsing/ processing, or sorting packed integer keys of all reads once
+//(radix sort) so every group is a run of contiguous reads
+enum class ReadGrouping
+{
+    hash,
+    sort
 };
-typedef std::shared_ptr<dataLine> umiDataLinePtr;
-typedef std::shared_ptr<const dataLine> dataLinePtr;
 
 //less operator to compare two dataLines, compares the length distance of the lines UMIs to the
-//origional length that this line is supposed to have
+//origional length that this line is supposed to have, then the reads of the UMI and finally the UMI itself
+//(a total order: the order of the lines and by that the UMI clusters must not depend on the order in which the lines were added)
 struct less_than_umi
 {
-    less_than_umi(const int& origionalLength, 
-    std::shared_ptr<std::unordered_map<const char*, std::vector<umiDataLinePtr>, 
-                    CharHash, CharPtrComparator>>& umiToReadsMap)
+    less_than_umi(const int& origionalLength, const dataLineArena& lines) : lines(lines)
     {
         this->origionalLength = origionalLength;
-        this->umiToReadsMap = umiToReadsMap;
     }
-    inline bool operator() (const dataLinePtr& line1, const dataLinePtr& line2)
+    inline bool operator() (const dataLineIdx& line1, const dataLineIdx& line2)
     {
-        int lenDiff1 = std::strlen(line1->umiSeq) - origionalLength;
+        int lenDiff1 = std::strlen(lines.umi_seq(line1)) - origionalLength;
         lenDiff1 = sqrt(lenDiff1*lenDiff1);
-        int lenDiff2 = std::strlen(line2->umiSeq) - origionalLength;
+        int lenDiff2 = std::strlen(lines.umi_seq(line2)) - origionalLength;
         lenDiff2 = sqrt(lenDiff2*lenDiff2);
 
-        unsigned long long readNum1 = umiToReadsMap->at(line1->umiSeq).size();
-        unsigned long long readNum2 = umiToReadsMap->at(line2->umiSeq).size();
+        unsigned long long readNum1 = lines.umiReads[line1];
+        unsigned long long readNum2 = lines.umiReads[line2];
 
         if(lenDiff1 != lenDiff2)
         {
             return (lenDiff1 < lenDiff2);
         }
-        else
+        else if(readNum1 != readNum2)
         {
             return(readNum1 > readNum2);
         }
+        return(std::strcmp(lines.umi_seq(line1), lines.umi_seq(line2)) < 0);
     }
     int origionalLength;
-    std::shared_ptr<std::unordered_map<const char*, std::vector<umiDataLinePtr>, 
-                    CharHash, CharPtrComparator>> umiToReadsMap;
+    const dataLineArena& lines;
 };
 
 /**
@@ -78,103 +262,195 @@ class UnprocessedDemultiplexedData
         UnprocessedDemultiplexedData()
         {
             uniqueChars = std::make_shared<UniqueCharSet>();
-            positionsOfUmiPtr = std::make_shared< std::unordered_map<const char*, std::vector<umiDataLinePtr>, CharHash, CharPtrComparator> >();
-            positonsOfABSingleCellPtr = std::make_shared< std::unordered_map<const char*, std::vector<dataLinePtr>, CharHash, CharPtrComparator> >();
+            dataLines = std::make_shared<dataLineArena>(*uniqueChars);
+            positionsOfUmiPtr = std::make_shared<UmiReadDict>();
+            positonsOfABSingleCellPtr = std::make_shared<AbScReadDict>();
+            wildtypeClass = uniqueChars->getHandle("wildtype");
         }
 
-        //during parsing of the demultiplexed reads we add all reads firstly to a tmp structure if we also parse guide reads
-        //this functions stores the AB count data in a temporary vector
-        void add_to_tmp_dataLines(std::string& umiStr, std::string& abStr, std::string& singleCellStr, std::string& treatment,
-        std::vector<dataLine> abDataLines)
-        {
-            dataLine line;
-            line.umiSeq = uniqueChars->getUniqueChar(umiStr.c_str());
-            line.abName = uniqueChars->getUniqueChar(abStr.c_str());
-            line.scID = uniqueChars->getUniqueChar(singleCellStr.c_str());
-            line.treatmentName = uniqueChars->getUniqueChar(treatment.c_str());
-
-            abDataLines.push_back(line);
-        }
         //this fucntion stores the guide reads in a map, mapping scIds to the occurence of the different class labels
-        void add_tmp_class_line(std::string& className, std::string& scId,
-                    std::unordered_map< const char*, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict,
+        void add_tmp_class_line(std::string& className, const scKey& scId,
+                    std::unordered_map< scKey, std::unordered_map< const char*, UnorderedSetCharPtr>>& scClasseCountDict,
                     const char* tmpUmi)
         {
             const char* uniqueUmi = uniqueChars->getUniqueChar(tmpUmi); //adding the temporary char* of the parsed line into our unique char dict
-
-            const char* scCharPtr = uniqueChars->getUniqueChar(scId.c_str());
             const char* nameCharPtr = uniqueChars->getUniqueChar(className.c_str());
 
-            //increase the count of this class for the specific cell
-            if(scClasseCountDict.find(scCharPtr) == scClasseCountDict.end())
-            {
-                std::unordered_map<const char*, UnorderedSetCharPtr> map;
-                UnorderedSetCharPtr set;
-                set.insert(uniqueUmi);
-                map.insert(std::make_pair(nameCharPtr, set));
-                scClasseCountDict.insert(std::make_pair(scCharPtr, map));
-            }
-            //if not add this new umi with this actual position to map
-            else
+            //increase the count of this class for the specific cell (creates the entries for cell and class if not present yet)
+            scClasseCountDict[scId][nameCharPtr].insert(uniqueUmi);
+        }
+
+        // add a dataLine to the arena and its index to the UMI dict
+        void add_to_umiDict(const char* umiChar, std::string& abStr, const scKey& singleCell, std::string& treatment,
+                            const unsigned long long& readCount = 1)
+        {
+            //get unique handle for all strings
+            dataLineIdx line = dataLines->add_line(uniqueChars->getHandle(umiChar),
+                                                   uniqueChars->getHandle(abStr),
+                                                   singleCell,
+                                                   uniqueChars->getHandle(treatment),
+                                                   readCount);
+
+            if(grouping == ReadGrouping::hash){add_dataLine_to_umiDict(line);}
+        }
+
+        // add a dataLine to the arena and its index to the AbSc dict
+        void add_to_scAbDict(const char* umiChar, std::string& abStr, const scKey& singleCell, std::string& treatment,
+                             const unsigned long long& readCount = 1)
+        {
+            //get unique handle for all strings
+            dataLineIdx line = dataLines->add_line(uniqueChars->getHandle(umiChar),
+                                                   uniqueChars->getHandle(abStr),
+                                                   singleCell,
+                                                   uniqueChars->getHandle(treatment),
+                                                   readCount);
+
+            if(grouping == ReadGrouping::hash){add_dataLine_to_scabDict(line);}
+        }
+
+        // add a dataLine that was already processed (reads of a UMI were checked) to the arena and the AbSc dict,
+        //used to load reads of an out of core partition (an empty class name is no class)
+        void add_processed_line(const std::string& umi, const std::string& ab, const scKey& singleCell, const std::string& treatment,
+                                const std::string& cellClass, const unsigned long long& umiCount, const unsigned long long& umiReads,
+                                const unsigned long long& readCount)
+        {
+            dataLineIdx line = dataLines->add_line(uniqueChars->getHandle(umi),
+                                                   uniqueChars->getHandle(ab),
+                                                   singleCell,
+                                                   uniqueChars->getHandle(treatment),
+                                                   readCount);
+            add_to_scAbDict(line, umiCount, umiReads, cellClass.empty() ? dataLineArena::noString : uniqueChars->getHandle(cellClass));
+        }
+
+        //remove all reads (e.g. before loading the next partition for out of core processing),
+        //the dicts of barcode names and the class of every single cell r kept
+        void clear_reads()
+        {
+            std::shared_ptr<UniqueCharSet> oldChars = uniqueChars;
+            uniqueChars = std::make_shared<UniqueCharSet>();
+            dataLines = std::make_shared<dataLineArena>(*uniqueChars);
+            positionsOfUmiPtr = std::make_shared<UmiReadDict>();
+            positonsOfABSingleCellPtr = std::make_shared<AbScReadDict>();
+            std::vector<dataLineIdx>().swap(sortedUmiLines);
+            std::vector<dataLineIdx>().swap(sortedAbScLines);
+
+            //class names r stored in the old UniqueCharSet
+            for(std::pair<const scKey, charHandle>& scClass : scClassMap)
             {
-                std::unordered_map<const char*, UnorderedSetCharPtr> innerMap = scClasseCountDict.at(scCharPtr);
-                if(innerMap.find(nameCharPtr) == innerMap.end())
-                {
-                    std::unordered_map<const char*, UnorderedSetCharPtr> map;
-                    UnorderedSetCharPtr set;
-                    set.insert(uniqueUmi);
-                    scClasseCountDict.at(scCharPtr).insert(std::make_pair(nameCharPtr, set));
-                }
-                else
-                {
-                    (scClasseCountDict.at(scCharPtr).at(nameCharPtr)).insert(uniqueUmi);
-                }
+                scClass.second = uniqueChars->getHandle(oldChars->getChar(scClass.second));
             }
+            wildtypeClass = uniqueChars->getHandle("wildtype");
         }
 
-        // add a dataLines to the vector
-        void add_to_umiDict(const char* umiChar, std::string& abStr, std::string& singleCellStr, std::string& treatment)
+        // add a umi dataline to its final ABSc Dict structure (add a class name and add to dict)
+        //(when grouping by sorting the line is only marked as kept by its umiCount, must not be locked)
+        void add_to_scAbDict(const dataLineIdx& line, const unsigned long long& umiCount, const unsigned long long& umiReads,
+                             const charHandle& cellClass = dataLineArena::noString)
         {
-            //get unique pointer for all three strings
-            dataLine line;
-            line.umiSeq = uniqueChars->getUniqueChar(umiChar);
-            line.abName = uniqueChars->getUniqueChar(abStr.c_str());
-            line.scID = uniqueChars->getUniqueChar(singleCellStr.c_str());
-            line.treatmentName = uniqueChars->getUniqueChar(treatment.c_str());
-
-            //make a dataLinePtr from those unique strings
-            umiDataLinePtr linePtr(std::make_shared<dataLine>(line));
+            //add class name (each line is only set by the thread processing its UMI)
+            dataLines->cellClassname[line] = cellClass;
+            dataLines->umiCount[line] = umiCount;
+            dataLines->umiReads[line] = umiReads;
+            
+            if(grouping == ReadGrouping::hash){add_dataLine_to_scabDict(line);}
+        }
 
-            //add it to our dataStructure (3 entries have to be set)
-            add_dataLine_to_umiDict(linePtr);
+        //call func(name, memoryUsage) for every data structure: the unique strings, the arena of reads (objects r reads),
+        //the UMI and AB-SC dicts (objects r UMIs and AB-SC groups) or the sorted reads when grouping by sorting
+        template<typename Func>
+        void for_each_memory_usage(Func func) const
+        {
+            func("UniqueCharSet", uniqueChars->memory_usage());
+            func("dataLineArena", dataLines->memory_usage());
+
+            memoryUsage umiDict;
+            umiDict.bytes = hash_table_bytes(*positionsOfUmiPtr);
+            umiDict.objects = positionsOfUmiPtr->size();
+            for(const std::pair<const char* const, std::vector<dataLineIdx>>& umi : *positionsOfUmiPtr){umiDict.bytes += vector_bytes(umi.second);}
+            func("UmiReadDict", umiDict);
+
+            memoryUsage abScDict;
+            abScDict.bytes = hash_table_bytes(*positonsOfABSingleCellPtr);
+            abScDict.objects = positonsOfABSingleCellPtr->size();
+            for(const std::pair<const AbScKey, std::vector<dataLineIdx>>& abSc : *positonsOfABSingleCellPtr){abScDict.bytes += vector_bytes(abSc.second);}
+            func("AbScReadDict", abScDict);
+
+            memoryUsage sortedLines;
+            sortedLines.bytes = vector_bytes(sortedUmiLines) + vector_bytes(sortedAbScLines);
+            sortedLines.objects = sortedUmiLines.size() + sortedAbScLines.size();
+            func("sortedReadGroups", sortedLines);
+
+            memoryUsage classMap;
+            classMap.bytes = hash_table_bytes(scClassMap);
+            classMap.objects = scClassMap.size();
+            func("scClassMap", classMap);
         }
 
-        // add a dataLines to the vector
-        void add_to_scAbDict(const char* umiChar, std::string& abStr, std::string& singleCellStr, std::string& treatment)
+        //must be set before adding reads
+        inline void setReadGrouping(const ReadGrouping& readGrouping)
+        {
+            grouping = readGrouping;
+        }
+        inline const ReadGrouping& getReadGrouping() const
         {
-            //get unique pointer for all three strings
-            dataLine line;
-            line.umiSeq = uniqueChars->getUniqueChar(umiChar);
-            line.abName = uniqueChars->getUniqueChar(abStr.c_str());
-            line.scID = uniqueChars->getUniqueChar(singleCellStr.c_str());
-            line.treatmentName = uniqueChars->getUniqueChar(treatment.c_str());
+            return grouping;
+        }
 
-            //make a dataLinePtr from those unique strings
-            dataLinePtr linePtr(std::make_shared<dataLine>(line));
+        //all reads grouped by UMI (reads of the UMI dict, or runs of reads sorted by UMI)
+        void get_umi_groups(std::vector<readGroup>& groups, const int& threads)
+        {
+            groups.clear();
+            if(grouping == ReadGrouping::hash)
+            {
+                groups.reserve(positionsOfUmiPtr->size());
+                for(UmiReadDict::const_iterator it = positionsOfUmiPtr->begin(); it != positionsOfUmiPtr->end(); ++it)
+                {
+                    groups.emplace_back(it->second);
+                }
+                return;
+            }
 
-            //add it to our dataStructure (3 entries have to be set)
-            add_dataLine_to_scabDict(linePtr);
+            //UMIs r unique chars: the 32 bit handle is the key of the UMI
+            std::vector<radixRecord<dataLineIdx>> records;
+            records.reserve(dataLines->size());
+            for(size_t line = 0; line < dataLines->size(); ++line)
+            {
+                if(dataLines->umi_seq(line)[0] == '\0'){continue;}
+                records.push_back(radixRecord<dataLineIdx>{dataLines->umiSeq[line], dataLineIdx(line)});
+            }
+            parallel_radix_sort(records, threads);
+            make_groups(records, sortedUmiLines, groups, false);
         }
 
-        // add a umi dataline to its final ABSc Dict structure (add a class name and add to dict)
-        void add_to_scAbDict(const umiDataLinePtr& line, unsigned long long& umiCount, const char* cellClass = nullptr)
+        //all reads that were kept after processing the UMIs grouped by AB-SC (reads of the AB-SC dict, or runs of reads sorted by AB-SC)
+        void get_ab_sc_groups(std::vector<readGroup>& groups, const int& threads)
         {
-            //add class name
-            line->cellClassname = cellClass;
-            line->umiCount = umiCount;
-            
-            //add it to our dataStructure (3 entries have to be set)
-            add_dataLine_to_scabDict(line);
+            groups.clear();
+            if(grouping == ReadGrouping::hash)
+            {
+                groups.reserve(positonsOfABSingleCellPtr->size());
+                for(AbScReadDict::const_iterator it = positonsOfABSingleCellPtr->begin(); it != positonsOfABSingleCellPtr->end(); ++it)
+                {
+                    groups.emplace_back(it->second);
+                }
+                return;
+            }
+
+            //kept reads: reads without UMI and the first read of every kept AB-SC of a UMI (has a umiCount)
+            //sorted by AB and then by single cell (stable, so its the order of (single cell, AB))
+            std::vector<radixRecord<dataLineIdx>> records;
+            for(size_t line = 0; line < dataLines->size(); ++line)
+            {
+                if(dataLines->umi_seq(line)[0] != '\0' && dataLines->umiCount[line] == 0){continue;}
+                records.push_back(radixRecord<dataLineIdx>{dataLines->abName[line], dataLineIdx(line)});
+            }
+            parallel_radix_sort(records, threads);
+            for(radixRecord<dataLineIdx>& record : records)
+            {
+                record.key = dataLines->scID[record.value];
+            }
+            parallel_radix_sort(records, threads);
+            make_groups(records, sortedAbScLines, groups, true);
         }
 
         inline std::shared_ptr<UniqueCharSet> getUniqueBarcodes() const
@@ -182,32 +458,23 @@ class UnprocessedDemultiplexedData
             return uniqueChars;
         }
         //return functions for our data, based on positions, UMI or AB/ SC barcodes
-        /*inline const std::vector<dataLinePtr> getData() const
+        inline const dataLineArena& getDataLines() const
         {
-            return data;
+            return *dataLines;
         }
-        inline dataLinePtr getDataAt(int pos) const
-        {
-            return data.at(pos);
-        }*/
-        inline std::vector<umiDataLinePtr> getDataWithUmi(const char* umi) const
+        inline const std::vector<dataLineIdx>& getDataWithUmi(const char* umi) const
         {
             return positionsOfUmiPtr->at(umi);
         }
-        inline std::vector<dataLinePtr> getDataWithAbSc(const char* ab, const char* sc) const
-        {
-            std::string abScIdxStr = std::string((ab)) + std::string((sc));
-            return positonsOfABSingleCellPtr->at(abScIdxStr.c_str());
-        }
-        inline std::vector<dataLinePtr> getDataWithAbSc(const char* absc) const
+        inline const std::vector<dataLineIdx>& getDataWithAbSc(const char* ab, const scKey& sc) const
         {
-            return positonsOfABSingleCellPtr->at(absc);
+            return positonsOfABSingleCellPtr->at(AbScKey(ab, sc));
         }
-        inline const std::shared_ptr< std::unordered_map<const char*, std::vector<umiDataLinePtr>, CharHash, CharPtrComparator>>getUniqueUmis() const
+        inline const std::shared_ptr<UmiReadDict> getUniqueUmis() const
         {
             return positionsOfUmiPtr;
         }
-        inline const std::shared_ptr< std::unordered_map<const char*, std::vector<dataLinePtr>, CharHash, CharPtrComparator>> getUniqueAbSc() const
+        inline const std::shared_ptr<AbScReadDict> getUniqueAbSc() const
         {
             return positonsOfABSingleCellPtr;
         }
@@ -215,30 +482,15 @@ class UnprocessedDemultiplexedData
         //we have to move the dataLine from the vector of lines for of oldUmi to newUmi
         //additionally inside this line we must update the new UMI sequence
         //THIS FUNCTION IS NOT TESTED, also not used at the moment: be aware when using !!!!
-        inline void changeUmi(const char* oldUmi, const char* newUmi, dataLinePtr oldLine)
+        inline void changeUmi(const char* oldUmi, const char* newUmi, const dataLineIdx& oldLine)
         {
-            //we have 3 dictionaries to update
-
-            //we have the key for the umiDict, but need the two keys for the other dicts
-            std::string abScIdxStr = std::string((oldLine->abName)) + std::string((oldLine->scID));
-            const char* abScIdxChar = uniqueChars->getUniqueChar(abScIdxStr.c_str());
-
-            std::string singleCell = std::string((oldLine->scID));
-            const char* singleCellChar = uniqueChars->getUniqueChar(singleCell.c_str());
-            
-            //remove all the old unnecessary lines from the dicts
-            remove(positionsOfUmiPtr->at(oldUmi).begin(), positionsOfUmiPtr->at(oldUmi).end(), oldLine);
-            remove(positonsOfABSingleCellPtr->at(abScIdxChar).begin(), positonsOfABSingleCellPtr->at(abScIdxChar).end(), oldLine);
+            //remove the line from the old UMI, the line stays at its position in the arena (and the AbSc dict)
+            std::vector<dataLineIdx>& oldUmiLines = positionsOfUmiPtr->at(oldUmi);
+            oldUmiLines.erase(std::remove(oldUmiLines.begin(), oldUmiLines.end(), oldLine), oldUmiLines.end());
 
-            //generate the new line
-            dataLine newLine = *oldLine;
-            newLine.umiSeq = newUmi;
-            std::shared_ptr<const dataLine> newLinePtr = std::make_shared<const dataLine>(newLine);
-            std::shared_ptr<dataLine> newLineUmiPtr = std::make_shared<dataLine> (newLine);
-
-            //and add the new line to all dicts
-            positionsOfUmiPtr->at(newUmi).push_back(newLineUmiPtr);
-            positonsOfABSingleCellPtr->at(abScIdxChar).push_back(newLinePtr);
+            //set the new UMI and add the line to the new UMI
+            dataLines->umiSeq[oldLine] = uniqueChars->getHandle(newUmi);
+            (*positionsOfUmiPtr)[newUmi].push_back(oldLine);
         }
         inline void setTreatmentDict(std::unordered_map<std::string, std::string > dict)
         {
@@ -252,9 +504,13 @@ class UnprocessedDemultiplexedData
         {
             classDict = dict;
         }
-        inline void set_cell_to_class_dict(std::unordered_map< const char*, const char*> tmpCcClassMap)
+        inline void set_cell_to_class_dict(const std::unordered_map< scKey, const char*>& tmpCcClassMap)
         {
-            scClassMap = tmpCcClassMap;
+            scClassMap.clear();
+            for(const std::pair<const scKey, const char*>& scClass : tmpCcClassMap)
+            {
+                scClassMap.insert(std::make_pair(scClass.first, uniqueChars->getHandle(scClass.second)));
+            }
         }
 
         inline std::string getProteinName(const std::string& barcode) const
@@ -292,13 +548,20 @@ class UnprocessedDemultiplexedData
             //else
             return proteinDict.at(barcode);
         }
-        inline const char* get_sc_class_name(const char* sc)
+        //class of a single cell, dataLineArena::noString if it has none
+        inline charHandle get_sc_class(const scKey& sc) const
         {
-            if(scClassMap.count(sc))
+            std::unordered_map< scKey, charHandle>::const_iterator scClass = scClassMap.find(sc);
+            if(scClass != scClassMap.end())
             {
-                return(scClassMap.at(sc));
+                return(scClass->second);
             }
-            return(nullptr);
+            return(dataLineArena::noString);
+        }
+        //class of single cells without class if they r kept
+        inline const charHandle& get_wildtype_class() const
+        {
+            return wildtypeClass;
         }
         inline bool check_class() const
         {
@@ -312,58 +575,60 @@ class UnprocessedDemultiplexedData
 
     private:
 
-        void add_dataLine_to_scabDict(const dataLinePtr& line)
+        void add_dataLine_to_scabDict(const dataLineIdx& line)
         {
          // 3.) INSERT ABSC POSITIONS
-            //same for AbSingleCell
-            std::string abScIdxStr = std::string((line->abName)) + std::string((line->scID));
-            
-            const char* abScIdxChar = uniqueChars->getUniqueChar(abScIdxStr.c_str());
-            if(positonsOfABSingleCellPtr->find(abScIdxChar) == positonsOfABSingleCellPtr->end())
-            {
-                std::vector<dataLinePtr> vec;
-                vec.push_back(line);
-                positonsOfABSingleCellPtr->insert(std::make_pair(abScIdxChar, vec));
-            }
-            //if not add this new umi with this actual position to map
-            else
-            {
-                positonsOfABSingleCellPtr->at(abScIdxChar).push_back(line);
-            }
+            //same for AbSingleCell (AB name is a unique char, the single cell an integer: no string concatenation needed)
+            (*positonsOfABSingleCellPtr)[AbScKey(dataLines->ab_name(line), dataLines->scID[line])].push_back(line);
+        }
+
+        void add_dataLine_to_umiDict(const dataLineIdx& line)
+        {
+            (*positionsOfUmiPtr)[dataLines->umi_seq(line)].push_back(line);
         }
 
-        void add_dataLine_to_umiDict(const umiDataLinePtr& line)
+        //store the sorted lines and make a group of each run of lines with the same key
+        //(for AB-SC the key is the single cell, a run of the same single cell is split where the AB changes: splitByAb)
+        void make_groups(const std::vector<radixRecord<dataLineIdx>>& records, std::vector<dataLineIdx>& sortedLines,
+                         std::vector<readGroup>& groups, const bool& splitByAb)
         {
-            if(positionsOfUmiPtr->find(line->umiSeq) == positionsOfUmiPtr->end())
+            sortedLines.resize(records.size());
+            for(size_t i = 0; i < records.size(); ++i)
             {
-                std::vector<umiDataLinePtr> vec;
-                vec.push_back(line);
-                positionsOfUmiPtr->insert(std::make_pair(line->umiSeq, vec));
+                sortedLines[i] = records[i].value;
             }
-            //if not add this new umi with this actual position to map
-            else
+            for(size_t runStart = 0; runStart < records.size();)
             {
-                (*positionsOfUmiPtr)[line->umiSeq].push_back(line);
+                size_t runEnd = runStart + 1;
+                while(runEnd < records.size() && records[runEnd].key == records[runStart].key &&
+                      (!splitByAb || dataLines->abName[records[runEnd].value] == dataLines->abName[records[runStart].value]))
+                {
+                    ++runEnd;
+                }
+                groups.emplace_back(sortedLines.data() + runStart, runEnd - runStart);
+                runStart = runEnd;
             }
         }
 
-        std::string uniqueAbSingleCellId(std::string abId, std::string singleCellId)
-        {
-            std::string id = abId + singleCellId;
-            return id;
-        }
+        //all demultiplexed lines, every line is stored exactly once in this arena and the dicts below only store its index
+        std::shared_ptr<dataLineArena> dataLines;
 
         //hash tables storing all the positions of dataLines for a unique (stored ad shared_ptr so handing those maps over during processing is cheap)
         // a) UMI  b) SingleCell-AB combination
         //the first dict to store all demultiplexed lines (they r ordered by the umi, bcs first we do a umi sanity check - one umi == one sc/ab - and collapse umis)
-        std::shared_ptr< std::unordered_map<const char*, std::vector<umiDataLinePtr>, CharHash, CharPtrComparator> > positionsOfUmiPtr;
-        //after collapsing the umis we store all reads as const dataLines, we only still perform a umiMM corrections step within reads of each AB/SC 
-        std::shared_ptr< std::unordered_map<const char*, std::vector<dataLinePtr>, CharHash, CharPtrComparator> > positonsOfABSingleCellPtr;
+        std::shared_ptr<UmiReadDict> positionsOfUmiPtr;
+        //after collapsing the umis we store the indices of all reads, we only still perform a umiMM corrections step within reads of each AB/SC 
+        std::shared_ptr<AbScReadDict> positonsOfABSingleCellPtr;
+        //instead of the dicts: all reads sorted by UMI, and the kept reads sorted by AB-SC (groups point into these vectors)
+        ReadGrouping grouping = ReadGrouping::hash;
+        std::vector<dataLineIdx> sortedUmiLines;
+        std::vector<dataLineIdx> sortedAbScLines;
 
-        std::unordered_map< const char*, const char*> scClassMap;
+        std::unordered_map< scKey, charHandle> scClassMap;
+        charHandle wildtypeClass;
 
         //all the string inside this class are stored only once, 
-        //for all strings scID, Ab-name, treatment-name we store the string only once, and then ptrs to it
+        //for all strings UMI, Ab-name, treatment-name we store the string only once, and then ptrs to it
         std::shared_ptr<UniqueCharSet> uniqueChars;
 
         //dictionaries to map a barcode-sequence to the treatment, and Protein, class
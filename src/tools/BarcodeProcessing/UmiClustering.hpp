@@ -0,0 +1,510 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define UMI_HAMMING_AVX2
+#endif
+
+#include "helper.hpp"
+#include "WorkStealingExecutor.hpp"
+
+//how UMIs of one AB in one single cell r collapsed:
+// greedy: the best UMI absorbs all UMIs within the allowed mismatches, repeated with the best remaining UMI (default)
+// directional: like greedy, but absorbed UMIs absorb their neighbours as well, if a UMI has at least 2*count - 1 reads of its neighbour
+// cluster: all UMIs connected by a path of UMIs within the allowed mismatches r one UMI
+enum class UmiClusteringMode
+{
+    greedy,
+    directional,
+    cluster
+};
+
+inline bool parseUmiClusteringMode(const std::string& name, UmiClusteringMode& mode)
+{
+    if(name == "greedy"){mode = UmiClusteringMode::greedy;}
+    else if(name == "directional"){mode = UmiClusteringMode::directional;}
+    else if(name == "cluster"){mode = UmiClusteringMode::cluster;}
+    else{return false;}
+    return true;
+}
+
+//distance between two UMIs:
+// levenshtein: edit distance (checked with outputSense) (default)
+// hamming: substitutions only, UMIs of different length r never collapsed
+enum class UmiDistance
+{
+    levenshtein,
+    hamming
+};
+
+inline bool parseUmiDistance(const std::string& name, UmiDistance& distance)
+{
+    if(name == "levenshtein"){distance = UmiDistance::levenshtein;}
+    else if(name == "hamming"){distance = UmiDistance::hamming;}
+    else{return false;}
+    return true;
+}
+
+//packs a UMI of up to 32 bases 2-bit into a 64bit integer, returns false for longer UMIs or UMIs with other bases than ACGT
+inline bool pack_umi(const char* umi, uint64_t& packed)
+{
+    packed = 0;
+    size_t i = 0;
+    for(; umi[i] != '\0'; ++i)
+    {
+        if(i == 32){return false;}
+        uint64_t base;
+        switch(umi[i])
+        {
+            case 'A': base = 0; break;
+            case 'C': base = 1; break;
+            case 'G': base = 2; break;
+            case 'T': base = 3; break;
+            default: return false;
+        }
+        packed |= (base << (2 * i));
+    }
+    return true;
+}
+
+//number of different bases of two packed UMIs (of same length): a base differs if any of its two bits differs
+inline int packed_hamming_distance(const uint64_t& a, const uint64_t& b)
+{
+    uint64_t diff = a ^ b;
+    return __builtin_popcountll((diff | (diff >> 1)) & 0x5555555555555555ULL);
+}
+
+#ifdef UMI_HAMMING_AVX2
+//four UMIs at a time: popcount of every byte with a nibble lookup table, summed up per 64bit UMI with sad_epu8
+__attribute__((target("avx2")))
+inline void packed_hamming_distances_avx2(const uint64_t& center, const uint64_t* packed, const size_t& size, unsigned char* distances)
+{
+    const __m256i centerVec = _mm256_set1_epi64x(center);
+    const __m256i lowBits = _mm256_set1_epi64x(0x5555555555555555LL);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+    const __m256i popcountTable = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                                   0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    size_t i = 0;
+    alignas(32) uint64_t sums[4];
+    for(; i + 4 <= size; i += 4)
+    {
+        __m256i diff = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed + i)), centerVec);
+        diff = _mm256_and_si256(_mm256_or_si256(diff, _mm256_srli_epi64(diff, 1)), lowBits);
+        __m256i count = _mm256_add_epi8(_mm256_shuffle_epi8(popcountTable, _mm256_and_si256(diff, lowNibble)),
+                                        _mm256_shuffle_epi8(popcountTable, _mm256_and_si256(_mm256_srli_epi16(diff, 4), lowNibble)));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sums), _mm256_sad_epu8(count, _mm256_setzero_si256()));
+        distances[i] = sums[0];
+        distances[i + 1] = sums[1];
+        distances[i + 2] = sums[2];
+        distances[i + 3] = sums[3];
+    }
+    for(; i < size; ++i)
+    {
+        distances[i] = packed_hamming_distance(center, packed[i]);
+    }
+}
+#endif
+
+//hamming distances of the center to all packed UMIs (with AVX2 if the CPU supports it)
+inline void packed_hamming_distances(const uint64_t& center, const uint64_t* packed, const size_t& size, unsigned char* distances)
+{
+#ifdef UMI_HAMMING_AVX2
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if(hasAvx2)
+    {
+        packed_hamming_distances_avx2(center, packed, size, distances);
+        return;
+    }
+#endif
+    for(size_t i = 0; i < size; ++i)
+    {
+        distances[i] = packed_hamming_distance(center, packed[i]);
+    }
+}
+
+//a collapsed UMI: the UMI of the center and the summed reads of all absorbed UMIs
+struct umiCluster
+{
+    size_t center;
+    unsigned long long readCount;
+    //the center was the last UMI left (such a UMI is always reported, even without reads)
+    bool lastUmi;
+};
+
+/**
+ * @brief Collapses the UMIs of the reads for one AB in one single cell.
+ * UMIs r ranked by the caller, the last UMI is the first center. The neighbours of a UMI (all UMIs within the allowed mismatches,
+ * checked with outputSense) r looked up in a deletion neighbourhood index for larger groups: every UMI is stored under all the strings we get by
+ * deleting up to 'mismatches' bases, two UMIs within an edit distance of 'mismatches' always share one of these strings.
+ * Like that only UMIs sharing a deletion string r compared and not all pairs of UMIs. For small groups comparing all UMIs is faster.
+ * For hamming distances UMIs r packed 2-bit and the distances of a UMI to all UMIs of the group r calculated at once with XOR+popcount.
+ * Larger groups use a pigeonhole index instead: a UMI is split into 'mismatches'+1 parts, two UMIs within a hamming distance of 'mismatches'
+ * always share one part, so only UMIs of same length sharing a part (and UMIs that could not be packed) r compared.
+ * For giant groups the neighbours of all UMIs can be searched in parallel before collapsing: every UMI is a task of an executor,
+ * the neighbour lists r sorted, and the collapsing runs on these lists (same result for any number of threads).
+ * Used by one thread at a time, all buffers r reused for the next group.
+ */
+class UmiClusterer
+{
+    public:
+        void set_parameters(const int& mismatches, const int& umiLength, const UmiClusteringMode& mode,
+                            const UmiDistance& distance = UmiDistance::levenshtein, const size_t& neighbourhoodMinUmis = 64)
+        {
+            this->mismatches = mismatches;
+            this->umiLength = umiLength;
+            this->mode = mode;
+            this->distance = distance;
+            this->neighbourhoodMinUmis = neighbourhoodMinUmis;
+        }
+
+        /** @brief collapse the UMIs
+         * @param umis UMI sequences, ranked (last UMI is the first center)
+         * @param counts number of reads for each UMI
+         * @param clusters the collapsed UMIs in the order they were found
+         * @param alignedUmis number of UMIs absorbed with at least one mismatch
+         * @param executor searches the neighbours of all UMIs in parallel before collapsing (nullptr to search them while collapsing)
+         */
+        void cluster(const std::vector<const char*>& umis, const std::vector<unsigned long long>& counts,
+                     std::vector<umiCluster>& clusters, unsigned long long& alignedUmis, WorkStealingExecutor* executor = nullptr)
+        {
+            clusters.clear();
+            alignedUmis = 0;
+            umiSeqs = &umis;
+            alive.assign(umis.size(), 1);
+            buffers.reset(umis.size());
+            size_t aliveUmis = umis.size();
+
+            lengths.resize(umis.size());
+            for(size_t umi = 0; umi < umis.size(); ++umi)
+            {
+                lengths[umi] = strlen(umis[umi]);
+            }
+
+            useIndex = (umis.size() >= neighbourhoodMinUmis);
+            if(distance == UmiDistance::hamming)
+            {
+                pack_umis();
+                if(useIndex){build_hamming_index();}
+            }
+            else if(useIndex)
+            {
+                build_index();
+            }
+            precomputedNeighbours = (executor != nullptr);
+            if(precomputedNeighbours)
+            {
+                search_all_neighbours(*executor);
+            }
+
+            for(size_t center = umis.size(); center-- > 0;)
+            {
+                if(!alive[center]){continue;}
+
+                //UMIs that r too long or too short never become a center
+                alive[center] = 0;
+                --aliveUmis;
+                if( std::abs(int(lengths[center]) - umiLength) >  mismatches)
+                {
+                    continue;
+                }
+                if(aliveUmis == 0)
+                {
+                    clusters.push_back(umiCluster{center, counts[center], true});
+                    break;
+                }
+
+                //absorb neighbours of the center (and for directional/ cluster also their neighbours)
+                unsigned long long readCount = counts[center];
+                queue.clear();
+                queue.push_back(center);
+                for(size_t queuePos = 0; queuePos < queue.size(); ++queuePos)
+                {
+                    const size_t umi = queue[queuePos];
+                    for_each_alive_neighbour(umi, [&](const size_t& neighbour, const int& dist)
+                    {
+                        if(mode == UmiClusteringMode::directional && counts[umi] + 1 < 2 * counts[neighbour])
+                        {
+                            return;
+                        }
+                        alive[neighbour] = 0;
+                        --aliveUmis;
+                        readCount += counts[neighbour];
+                        if(dist > 0){++alignedUmis;}
+                        if(mode != UmiClusteringMode::greedy){queue.push_back(neighbour);}
+                    });
+                }
+                clusters.push_back(umiCluster{center, readCount, false});
+            }
+        }
+
+    private:
+
+        //scratch space to search neighbours, one per searching thread
+        struct searchBuffers
+        {
+            std::vector<unsigned int> visited;
+            unsigned int visitStamp = 0;
+            std::string deletionBuffer;
+            std::vector<unsigned char> distances;
+
+            void reset(const size_t& size)
+            {
+                visited.assign(size, 0);
+                visitStamp = 0;
+                distances.resize(size);
+            }
+        };
+
+        //calls func(neighbour, dist) for all alive UMIs within the allowed mismatches of umi
+        template<typename Func>
+        void for_each_alive_neighbour(const size_t& umi, Func func)
+        {
+            if(!precomputedNeighbours)
+            {
+                for_each_neighbour(umi, true, buffers, func);
+                return;
+            }
+            for(const std::pair<size_t, int>& neighbour : neighbourLists[umi])
+            {
+                if(alive[neighbour.first]){func(neighbour.first, neighbour.second);}
+            }
+        }
+
+        //calls func(neighbour, dist) for all UMIs within the allowed mismatches of umi (only alive UMIs if onlyAlive)
+        template<typename Func>
+        void for_each_neighbour(const size_t& umi, const bool& onlyAlive, searchBuffers& buffer, Func& func)
+        {
+            const char* umiSeq = (*umiSeqs)[umi];
+            if(distance == UmiDistance::hamming)
+            {
+                for_each_hamming_neighbour(umi, onlyAlive, buffer, func);
+                return;
+            }
+            if(!useIndex)
+            {
+                for(size_t other = 0; other < umiSeqs->size(); ++other)
+                {
+                    if(!onlyAlive || alive[other]){check_neighbour(umiSeq, umi, other, func);}
+                }
+                return;
+            }
+
+            //all UMIs sharing a deletion string with this UMI r candidates
+            ++buffer.visitStamp;
+            for_each_deletion(umiSeq, buffer, [&](const size_t& hash)
+            {
+                std::vector<std::pair<size_t, size_t>>::const_iterator entryIt =
+                    std::lower_bound(index.begin(), index.end(), std::make_pair(hash, size_t(0)));
+                for(; entryIt != index.end() && entryIt->first == hash; ++entryIt)
+                {
+                    const size_t other = entryIt->second;
+                    if((onlyAlive && !alive[other]) || buffer.visited[other] == buffer.visitStamp){continue;}
+                    buffer.visited[other] = buffer.visitStamp;
+                    check_neighbour(umiSeq, umi, other, func);
+                }
+            });
+        }
+
+        template<typename Func>
+        inline void check_neighbour(const char* umiSeq, const size_t& umi, const size_t& other, Func& func)
+        {
+            int dist = INT_MAX;
+            outputSense(umiSeq, lengths[umi], (*umiSeqs)[other], lengths[other], mismatches, dist);
+            if(dist <= mismatches)
+            {
+                func(other, dist);
+            }
+        }
+
+        template<typename Func>
+        void for_each_hamming_neighbour(const size_t& umi, const bool& onlyAlive, searchBuffers& buffer, Func& func)
+        {
+            //UMIs that could not be packed r not in the index and compared to all UMIs
+            if(!useIndex || !packable[umi])
+            {
+                packed_hamming_distances(packed[umi], packed.data(), packed.size(), buffer.distances.data());
+                for(size_t other = 0; other < packed.size(); ++other)
+                {
+                    if((onlyAlive && !alive[other]) || lengths[other] != lengths[umi]){continue;}
+                    int dist = (packable[umi] && packable[other]) ? buffer.distances[other] : unpacked_hamming_distance(umi, other);
+                    if(dist <= mismatches)
+                    {
+                        func(other, dist);
+                    }
+                }
+                return;
+            }
+
+            //all UMIs sharing a part with this UMI r candidates
+            ++buffer.visitStamp;
+            for(int part = 0; part <= mismatches; ++part)
+            {
+                const size_t key = hamming_part_key(umi, part);
+                std::vector<std::pair<size_t, size_t>>::const_iterator entryIt =
+                    std::lower_bound(index.begin(), index.end(), std::make_pair(key, size_t(0)));
+                for(; entryIt != index.end() && entryIt->first == key; ++entryIt)
+                {
+                    const size_t other = entryIt->second;
+                    if((onlyAlive && !alive[other]) || buffer.visited[other] == buffer.visitStamp){continue;}
+                    buffer.visited[other] = buffer.visitStamp;
+                    if(lengths[other] != lengths[umi]){continue;}
+                    int dist = packed_hamming_distance(packed[umi], packed[other]);
+                    if(dist <= mismatches)
+                    {
+                        func(other, dist);
+                    }
+                }
+            }
+            for(const size_t& other : unpackedUmis)
+            {
+                if((onlyAlive && !alive[other]) || lengths[other] != lengths[umi]){continue;}
+                int dist = unpacked_hamming_distance(umi, other);
+                if(dist <= mismatches)
+                {
+                    func(other, dist);
+                }
+            }
+        }
+
+        //UMIs with N or longer UMIs r compared base by base
+        inline int unpacked_hamming_distance(const size_t& umi, const size_t& other) const
+        {
+            int dist = 0;
+            const char* umiSeq = (*umiSeqs)[umi];
+            const char* otherSeq = (*umiSeqs)[other];
+            for(size_t i = 0; i < lengths[umi]; ++i)
+            {
+                if(umiSeq[i] != otherSeq[i]){++dist;}
+            }
+            return dist;
+        }
+
+        //hash of the length of a packed UMI, the part and the bases of this part
+        inline size_t hamming_part_key(const size_t& umi, const int& part) const
+        {
+            const size_t parts = mismatches + 1;
+            const size_t start = part * lengths[umi] / parts;
+            const size_t end = (part + 1) * lengths[umi] / parts;
+            const uint64_t mask = (end - start == 32) ? ~uint64_t(0) : ((uint64_t(1) << (2 * (end - start))) - 1);
+            const uint64_t bases = (packed[umi] >> (2 * start)) & mask;
+            return((bases * 0x9E3779B97F4A7C15ULL) ^ (uint64_t(lengths[umi]) << 8) ^ uint64_t(part));
+        }
+
+        //search the neighbours of all UMIs (except itself) in parallel, one task per UMI
+        void search_all_neighbours(WorkStealingExecutor& executor)
+        {
+            const size_t size = umiSeqs->size();
+            neighbourLists.resize(size);
+            ThreadLocalShards<searchBuffers> threadBuffers;
+            executor.run(size, [&](const size_t& umi)
+            {
+                searchBuffers& threadBuffer = threadBuffers.local();
+                if(threadBuffer.visited.size() != size){threadBuffer.reset(size);}
+                std::vector<std::pair<size_t, int>>& neighbours = neighbourLists[umi];
+                neighbours.clear();
+                auto addNeighbour = [&](const size_t& neighbour, const int& dist)
+                {
+                    if(neighbour != umi){neighbours.emplace_back(neighbour, dist);}
+                };
+                for_each_neighbour(umi, false, threadBuffer, addNeighbour);
+                //the order of the neighbours must not depend on the search
+                std::sort(neighbours.begin(), neighbours.end());
+            },
+            [](const size_t&){return(0ULL);});
+        }
+
+        void pack_umis()
+        {
+            const size_t size = umiSeqs->size();
+            packed.resize(size);
+            packable.resize(size);
+            for(size_t umi = 0; umi < size; ++umi)
+            {
+                packable[umi] = pack_umi((*umiSeqs)[umi], packed[umi]);
+            }
+        }
+
+        //sorted list of (hash of a part, UMI) for all packed UMIs, the other UMIs r listed in unpackedUmis
+        void build_hamming_index()
+        {
+            index.clear();
+            unpackedUmis.clear();
+            for(size_t umi = 0; umi < umiSeqs->size(); ++umi)
+            {
+                if(!packable[umi])
+                {
+                    unpackedUmis.push_back(umi);
+                    continue;
+                }
+                for(int part = 0; part <= mismatches; ++part)
+                {
+                    index.emplace_back(hamming_part_key(umi, part), umi);
+                }
+            }
+            std::sort(index.begin(), index.end());
+        }
+
+        //sorted list of (hash of deletion string, UMI) for all UMIs
+        void build_index()
+        {
+            index.clear();
+            for(size_t umi = 0; umi < umiSeqs->size(); ++umi)
+            {
+                for_each_deletion((*umiSeqs)[umi], buffers, [&](const size_t& hash){index.emplace_back(hash, umi);});
+            }
+            std::sort(index.begin(), index.end());
+        }
+
+        //calls func with the hash of every string we get by deleting up to 'mismatches' bases of the sequence
+        template<typename Func>
+        void for_each_deletion(const char* sequence, searchBuffers& buffer, Func func)
+        {
+            buffer.deletionBuffer.assign(sequence);
+            add_deletions(buffer.deletionBuffer, 0, 0, func);
+        }
+        template<typename Func>
+        void add_deletions(std::string& deletionBuffer, const size_t& start, const int& deletions, Func& func)
+        {
+            func(std::hash<std::string_view>()(deletionBuffer));
+            if(deletions == mismatches){return;}
+            for(size_t pos = start; pos < deletionBuffer.size(); ++pos)
+            {
+                //only delete the first base of a run of same bases (deleting any other base of the run gives the same string)
+                if(pos > start && deletionBuffer[pos] == deletionBuffer[pos - 1]){continue;}
+                char base = deletionBuffer[pos];
+                deletionBuffer.erase(pos, 1);
+                add_deletions(deletionBuffer, pos, deletions + 1, func);
+                deletionBuffer.insert(deletionBuffer.begin() + pos, base);
+            }
+        }
+
+        int mismatches = 0;
+        int umiLength = 0;
+        UmiClusteringMode mode = UmiClusteringMode::greedy;
+        UmiDistance distance = UmiDistance::levenshtein;
+        size_t neighbourhoodMinUmis = 64;
+
+        //buffers for the current group
+        const std::vector<const char*>* umiSeqs = nullptr;
+        std::vector<char> alive;
+        searchBuffers buffers;
+        std::vector<size_t> queue;
+        bool useIndex = false;
+        std::vector<std::pair<size_t, size_t>> index;
+        std::vector<unsigned int> lengths;
+        //packed UMIs for hamming distances
+        std::vector<uint64_t> packed;
+        std::vector<char> packable;
+        std::vector<size_t> unpackedUmis;
+        //neighbours of all UMIs searched in parallel (for giant groups)
+        bool precomputedNeighbours = false;
+        std::vector<std::vector<std::pair<size_t, int>>> neighbourLists;
+};
@@ -28,7 +28,9 @@ bool parse_arguments(char** argv, int argc, std::string& inFile,  std::string& o
                      std::string& barcodeFile, std::string& barcodeIndices, int& umiMismatches,
                      std::string& abFile, int& abIdx, std::string& treatmentFile, int& treatmentIdx,
                      std::string& classSeqFile, std::string& classNameFile, double& umiThreshold,
-                     bool scClassConstraint, std::string& guideReadsFile)
+                     bool scClassConstraint, std::string& guideReadsFile, std::string& umiClustering,
+                     std::string& umiDistance, unsigned long long& parallelGroupSize,
+                     std::string& readGrouping, double& maxMemory)
 {
     try
     {
@@ -63,6 +65,18 @@ bool parse_arguments(char** argv, int argc, std::string& inFile,  std::string& o
             than 90percent of them have the same UMI. All other reads are deleted.")
             ("scClassConstraint,k", value<bool>(&scClassConstraint)->default_value(true), "Boolean to store whether sc reads should be removed if we find no guide read for them. \
             If set to false reads for no guide are given the class wildtype.")
+            ("umiClustering,l", value<std::string>(&umiClustering)->default_value("greedy"), "how UMIs of one AB in one single cell are collapsed: \
+            greedy (the UMI with most reads absorbs all UMIs within the allowed mismatches), directional (absorbed UMIs also absorb their neighbours \
+            if they have at least 2*count-1 reads of them, like UMI-tools) or cluster (all UMIs connected by UMIs within the allowed mismatches are one UMI).")
+            ("umiDistance,e", value<std::string>(&umiDistance)->default_value("levenshtein"), "distance between UMIs: levenshtein (edit distance) or hamming \
+            (substitutions only, much faster, UMIs of different length are never collapsed).")
+            ("parallelGroupSize,p", value<unsigned long long>(&parallelGroupSize)->default_value(20000), "AB-SC groups with at least this many reads \
+            are collapsed with all threads together (the UMI neighbours are searched in parallel). Set to 0 to never split groups.")
+            ("readGrouping,s", value<std::string>(&readGrouping)->default_value("hash"), "how reads are grouped by UMI and AB/single cell: hash (insert every \
+            read into hash maps) or sort (radix sort all reads once by packed integer keys, groups are runs of contiguous reads; less memory and allocations).")
+            ("maxMemory,m", value<double>(&maxMemory)->default_value(0), "memory budget in GB. If set, reads are processed out of core: they are partitioned \
+            into spill files (next to the output) so that the parsed reads of each partition fit into the budget. The memory per read is measured on the first \
+            262144 reads, the processing steps need additional memory for the groups of reads. 0 keeps all reads in memory.")
 
             ("help,h", "help message");
 
@@ -248,11 +262,16 @@ int main(int argc, char** argv)
     std::string classSeqFile;
     std::string classNameFile;
     std::string guideReadsFile;
+    std::string umiClustering;
+    std::string umiDistance;
+    unsigned long long parallelGroupSize;
+    std::string readGrouping;
+    double maxMemory;
 
     if(!parse_arguments(argv, argc, inFile, outFile, thread, barcodeFile, barcodeIndices, 
                         umiMismatches, abFile, abIdx, treatmentFile, treatmentIdx,
                         classSeqFile, classNameFile, umiThreshold, scClassConstraint, 
-                        guideReadsFile))
+                        guideReadsFile, umiClustering, umiDistance, parallelGroupSize, readGrouping, maxMemory))
     {
         exit(EXIT_FAILURE);
     }
@@ -261,8 +280,32 @@ int main(int argc, char** argv)
     NBarcodeInformation barcodeIdData;
     generateBarcodeDicts(barcodeFile, barcodeIndices, barcodeIdData, abBarcodes, abIdx, &treatmentBarcodes, treatmentIdx);
     BarcodeProcessingHandler dataParser(barcodeIdData);
+    dataParser.getRunReport().set_tool("processing", thread);
     if(umiThreshold != -1){dataParser.setUmiFilterThreshold(umiThreshold);}
     dataParser.setScClassConstaint(scClassConstraint);
+    UmiClusteringMode umiClusteringMode;
+    if(!parseUmiClusteringMode(umiClustering, umiClusteringMode))
+    {
+        std::cerr << "Unknown UMI clustering method: " << umiClustering << ". Use greedy, directional or cluster.\n";
+        exit(EXIT_FAILURE);
+    }
+    dataParser.setUmiClusteringMode(umiClusteringMode);
+    UmiDistance umiDistanceType;
+    if(!parseUmiDistance(umiDistance, umiDistanceType))
+    {
+        std::cerr << "Unknown UMI distance: " << umiDistance << ". Use levenshtein or hamming.\n";
+        exit(EXIT_FAILURE);
+    }
+    dataParser.setUmiDistance(umiDistanceType);
+    dataParser.setParallelGroupSize(parallelGroupSize);
+    if(readGrouping == "hash"){dataParser.setReadGrouping(ReadGrouping::hash);}
+    else if(readGrouping == "sort"){dataParser.setReadGrouping(ReadGrouping::sort);}
+    else
+    {
+        std::cerr << "Unknown read grouping: " << readGrouping << ". Use hash or sort.\n";
+        exit(EXIT_FAILURE);
+    }
+    if(maxMemory > 0){dataParser.setMaxMemory(maxMemory, outFile + ".spill");}
 
     //generate dictionaries to map sequences to the real names of Protein/ treatment/ etc...
     if(!abFile.empty())
@@ -283,8 +326,8 @@ int main(int argc, char** argv)
 
     //parse the file of demultiplexed barcodes and
     //add all the data to the Unprocessed Demultiplexed Data (stored in rawData)
-    // (AB, treatment already are mapped to their real names, scID is a concatenation of numbers for each barcode in
-    //each abrcoding round, seperated by a dot)
+    // (AB, treatment already are mapped to their real names, scID is a mixed radix number with one digit for the barcode
+    //of each abrcoding round, it is only written as a dot seperated string in the output)
     if(guideReadsFile != "")
     {
         dataParser.parse_ab_and_guide_file(inFile, guideReadsFile, thread);
@@ -294,9 +337,18 @@ int main(int argc, char** argv)
         dataParser.parse_combined_file(inFile, thread);
     }
     //further process the data (correct UMIs, collapse same UMIs, etc.)
-    dataParser.processBarcodeMapping(umiMismatches, thread);
-    dataParser.writeLog(outFile);
-    dataParser.writeAbCountsPerSc(outFile);
+    if(dataParser.isOutOfCore())
+    {
+        dataParser.processBarcodeMappingOutOfCore(umiMismatches, thread, outFile);
+        dataParser.writeLog(outFile);
+    }
+    else
+    {
+        dataParser.processBarcodeMapping(umiMismatches, thread);
+        dataParser.writeLog(outFile);
+        dataParser.writeAbCountsPerSc(outFile);
+    }
+    dataParser.writeRunReport(outFile);
 
     return(EXIT_SUCCESS);
 }
\ No newline at end of file
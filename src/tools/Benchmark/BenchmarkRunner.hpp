@@ -0,0 +1,166 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <functional>
+
+//number of calls to operator new, counted by the replaced global operator new of the benchmark tool
+extern std::atomic<unsigned long long> allocationCount;
+
+//results r added to this sink, so that the benchmarked calls can not be removed by the compiler
+extern volatile unsigned long long benchmarkSink;
+
+//result of one benchmark: the median of all repetitions, and the fastest repetition
+struct benchmarkResult
+{
+    std::string name;
+    std::string type; // micro (ns per call of a kernel) or macro (a whole stage over all reads)
+    unsigned long long operations = 0; // calls (micro) or reads (macro) of one repetition
+    int repetitions = 0;
+    double nsPerOp = 0; // median
+    double nsPerOpMin = 0;
+    double opsPerSecond = 0; // calls/s or reads/s of the median repetition
+    double allocationsPerOp = 0;
+};
+
+/**
+ * @brief Runs micro benchmarks (a single kernel called in a loop) and macro benchmarks (a whole stage, like parsing or processing
+ * of all reads) and writes the results as table to stdout and as JSON.
+ * Every benchmark is repeated and the median is reported, the calls of a micro benchmark r batched so that one repetition runs at least minTime seconds,
+ * like that the numbers r repeatable across runs (together with a fixed seed for the generated data).
+ * Allocations r the calls of operator new during all repetitions divided by the operations.
+ */
+class BenchmarkRunner
+{
+    public:
+        BenchmarkRunner(const int& repetitions, const double& minTime, const std::string& filter)
+        : repetitions(repetitions < 1 ? 1 : repetitions), minTime(minTime), filter(filter){}
+
+        //true if the benchmark should run (its name contains the filter)
+        bool selected(const std::string& name) const
+        {
+            return(filter.empty() || name.find(filter) != std::string::npos);
+        }
+
+        /** @brief benchmark a kernel
+         * @param func func(iterations) calls the kernel iterations times
+         */
+        void run_micro(const std::string& name, std::function<void(const unsigned long long&)> func)
+        {
+            if(!selected(name)){return;}
+
+            //find the number of calls that run at least minTime (calls r doubled, the last run also warms up caches)
+            unsigned long long iterations = 1;
+            while(true)
+            {
+                double seconds = time_seconds([&](){func(iterations);});
+                if(seconds >= minTime || iterations >= (1ULL << 40)){break;}
+                iterations = (seconds < minTime / 100) ? iterations * 10 : iterations * 2;
+            }
+
+            std::vector<double> nsPerOp;
+            const unsigned long long allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            for(int repetition = 0; repetition < repetitions; ++repetition)
+            {
+                nsPerOp.push_back(time_seconds([&](){func(iterations);}) * 1e9 / iterations);
+            }
+            const unsigned long long allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            add_result(name, "micro", iterations, nsPerOp, allocations);
+        }
+
+        /** @brief benchmark a stage over all reads
+         * @param setup called before each repetition, not timed (e.g. parsing the reads for the processing step)
+         * @param func the timed stage
+         */
+        void run_macro(const std::string& name, const unsigned long long& reads,
+                       std::function<void()> setup, std::function<void()> func)
+        {
+            if(!selected(name)){return;}
+
+            std::vector<double> nsPerOp;
+            unsigned long long allocations = 0;
+            for(int repetition = 0; repetition < repetitions; ++repetition)
+            {
+                //the tools print their progress to stdout, it is muted during the benchmark
+                std::streambuf* coutBuffer = std::cout.rdbuf(nullptr);
+                setup();
+                const unsigned long long allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+                const double seconds = time_seconds(func);
+                allocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+                std::cout.rdbuf(coutBuffer);
+                nsPerOp.push_back(seconds * 1e9 / reads);
+            }
+            add_result(name, "macro", reads, nsPerOp, allocations);
+        }
+
+        //write all results as JSON, label identifies the version (e.g. a commit)
+        void write_json(const std::string& output, const std::string& label, const unsigned long long& reads,
+                        const unsigned long long& mappingReads, const int& threads, const unsigned int& seed) const
+        {
+            std::ofstream outputFile(output);
+            if(!outputFile.is_open())
+            {
+                std::cerr << "ERROR: Could not open the benchmark output file: " << output << "\n";
+                exit(EXIT_FAILURE);
+            }
+
+            outputFile << "{\n";
+            outputFile << "  \"label\": \"" << label << "\",\n";
+            outputFile << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+            outputFile << "  \"settings\": {\"reads\": " << reads << ", \"mappingReads\": " << mappingReads << ", \"threads\": " << threads << ", \"seed\": " << seed
+                       << ", \"repetitions\": " << repetitions << ", \"minTime\": " << minTime << "},\n";
+            outputFile << "  \"benchmarks\": [\n";
+            for(size_t i = 0; i < results.size(); ++i)
+            {
+                const benchmarkResult& result = results[i];
+                outputFile << "    {\"name\": \"" << result.name << "\", \"type\": \"" << result.type << "\", \"operations\": " << result.operations
+                           << ", \"repetitions\": " << result.repetitions << ", \"nsPerOp\": " << result.nsPerOp
+                           << ", \"nsPerOpMin\": " << result.nsPerOpMin << ", \"opsPerSecond\": " << result.opsPerSecond
+                           << ", \"allocationsPerOp\": " << result.allocationsPerOp << "}";
+                outputFile << ((i + 1 < results.size()) ? ",\n" : "\n");
+            }
+            outputFile << "  ]\n";
+            outputFile << "}\n";
+            outputFile.close();
+        }
+
+    private:
+        template<typename Func>
+        double time_seconds(Func func)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            func();
+            return(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        void add_result(const std::string& name, const std::string& type, const unsigned long long& operations,
+                        std::vector<double>& nsPerOp, const unsigned long long& allocations)
+        {
+            std::sort(nsPerOp.begin(), nsPerOp.end());
+            benchmarkResult result;
+            result.name = name;
+            result.type = type;
+            result.operations = operations;
+            result.repetitions = nsPerOp.size();
+            result.nsPerOp = nsPerOp[nsPerOp.size() / 2];
+            result.nsPerOpMin = nsPerOp.front();
+            result.opsPerSecond = (result.nsPerOp > 0) ? 1e9 / result.nsPerOp : 0;
+            result.allocationsPerOp = allocations / (double)(operations * nsPerOp.size());
+            results.push_back(result);
+
+            std::cout << name << "\t" << type << "\t" << result.nsPerOp << " ns/" << (type == "micro" ? "op" : "read") << "\t"
+                      << (unsigned long long)result.opsPerSecond << " " << (type == "micro" ? "ops/s" : "reads/s") << "\t"
+                      << result.allocationsPerOp << " allocs/" << (type == "micro" ? "op" : "read") << "\n";
+        }
+
+        int repetitions;
+        double minTime;
+        std::string filter;
+        std::vector<benchmarkResult> results;
+};
@@ -0,0 +1,476 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <zlib.h>
+
+#include <boost/program_options.hpp>
+#include <boost/program_options/options_description.hpp>
+
+#include "BarcodeMapping.hpp"
+#include "BarcodeProcessingHandler.hpp"
+#include "BenchmarkRunner.hpp"
+
+using namespace boost::program_options;
+
+/**
+ * Benchmarks of the kernels and stages of demultiplexing and processing, to track their performance across versions.
+ *
+ * Micro benchmarks call one kernel in a loop (levenshtein, outputSense, match_pattern of constant and variable barcodes,
+ * UniqueCharSet, DemultiplexedReads::addVector) and report ns/op and allocations/op.
+ * Macro benchmarks run a whole stage over all generated reads (reading txt/fastq files with the file policies, mapping,
+ * parsing, processing and writing of the processing tool) and report reads/s and allocations/read.
+ * All input data is generated from a fixed seed into the work directory, the results r written to stdout and as JSON.
+ * */
+
+std::atomic<unsigned long long> allocationCount(0);
+volatile unsigned long long benchmarkSink = 0;
+
+//count all allocations of the program
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if(void* ptr = std::malloc(size ? size : 1)){return ptr;}
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    if(void* ptr = std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align)){return ptr;}
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept {std::free(ptr);}
+void operator delete(void* ptr, std::size_t) noexcept {std::free(ptr);}
+void operator delete(void* ptr, std::align_val_t) noexcept {std::free(ptr);}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {std::free(ptr);}
+
+//layout of the generated reads: [CI barcode 1][linker 1][UMI][AB barcode][linker 2][CI barcode 2][linker 3][CI barcode 3]
+const std::vector<std::string> linkers = {"CTTGTGGAAAGGACGAAACACCG", "GTTTTAGAGCTAGAAATAGCAA", "CGAATGCTCTGGCCTACGC"};
+const std::string patternLine = "[NNNNNNNN][CTTGTGGAAAGGACGAAACACCG][XXXXXXXXXX][NNNNNNNNNN][GTTTTAGAGCTAGAAATAGCAA][NNNNNNNN][CGAATGCTCTGGCCTACGC][NNNNNNNN]";
+const std::string mismatchLine = "1,2,1,1,2,1,2,1";
+const int umiLength = 10;
+
+//the generated barcodes and molecules (a molecule is one UMI of an AB in a cell, reads r PCR duplicates of molecules)
+struct benchmarkData
+{
+    std::vector<std::vector<std::string>> barcodes; // CI round 1, AB, CI round 2, CI round 3 (the lines of the barcode file)
+    std::vector<std::vector<std::string>> molecules; // all barcodes of a read in the order of the pattern
+    std::vector<size_t> reads; // molecule of every read
+};
+
+std::string random_sequence(std::mt19937& generator, const int& length)
+{
+    const char bases[] = "ACGT";
+    std::uniform_int_distribution<int> base(0, 3);
+    std::string sequence;
+    for(int i = 0; i < length; ++i)
+    {
+        sequence.push_back(bases[base(generator)]);
+    }
+    return sequence;
+}
+
+//substitute each base with the given rate
+std::string mutate_sequence(std::mt19937& generator, std::string sequence, const double& rate)
+{
+    const char bases[] = "ACGT";
+    std::uniform_real_distribution<double> probability(0, 1);
+    std::uniform_int_distribution<int> base(0, 3);
+    for(char& c : sequence)
+    {
+        if(probability(generator) < rate){c = bases[base(generator)];}
+    }
+    return sequence;
+}
+
+void generate_data(benchmarkData& data, std::mt19937& generator, const unsigned long long& reads)
+{
+    const std::vector<std::pair<int, int>> barcodeTypes = {{96, 8}, {30, 10}, {96, 8}, {96, 8}}; //number and length of barcodes
+    for(const std::pair<int, int>& barcodeType : barcodeTypes)
+    {
+        std::vector<std::string> barcodes;
+        while(barcodes.size() < barcodeType.first)
+        {
+            std::string barcode = random_sequence(generator, barcodeType.second);
+            if(std::find(barcodes.begin(), barcodes.end(), barcode) == barcodes.end()){barcodes.push_back(barcode);}
+        }
+        data.barcodes.push_back(barcodes);
+    }
+
+    //2000 cells with on average 4 reads per molecule
+    std::vector<std::vector<std::string>> cells;
+    for(int cell = 0; cell < 2000; ++cell)
+    {
+        std::vector<std::string> cellBarcodes;
+        for(int round : {0, 2, 3})
+        {
+            cellBarcodes.push_back(data.barcodes[round][generator() % data.barcodes[round].size()]);
+        }
+        cells.push_back(cellBarcodes);
+    }
+    const size_t moleculeNumber = std::max<unsigned long long>(1, reads / 4);
+    for(size_t molecule = 0; molecule < moleculeNumber; ++molecule)
+    {
+        const std::vector<std::string>& cell = cells[generator() % cells.size()];
+        const std::string& ab = data.barcodes[1][generator() % data.barcodes[1].size()];
+        data.molecules.push_back({cell[0], linkers[0], random_sequence(generator, umiLength), ab, linkers[1], cell[1], linkers[2], cell[2]});
+    }
+    for(unsigned long long read = 0; read < reads; ++read)
+    {
+        data.reads.push_back(generator() % moleculeNumber);
+    }
+}
+
+//write the barcode file, the reads as fastq.gz and txt (for demultiplexing) and as demultiplexed tsv.gz (for processing),
+//the mapping is much slower than all other stages and gets an extra fastq.gz with only the first mappingReads reads
+void write_data(const benchmarkData& data, std::mt19937& generator, const std::string& workDir, const unsigned long long& mappingReads)
+{
+    std::ofstream barcodeFile(workDir + "/benchmark_barcodes.txt");
+    for(const std::vector<std::string>& barcodes : data.barcodes)
+    {
+        for(size_t i = 0; i < barcodes.size(); ++i)
+        {
+            barcodeFile << barcodes[i] << ((i + 1 < barcodes.size()) ? "," : "\n");
+        }
+    }
+    barcodeFile.close();
+
+    gzFile fastqFile = gzopen((workDir + "/benchmark_reads.fastq.gz").c_str(), "wb");
+    gzFile mappingFastqFile = gzopen((workDir + "/benchmark_mapping_reads.fastq.gz").c_str(), "wb");
+    gzFile tsvFile = gzopen((workDir + "/benchmark_demultiplexed.tsv.gz").c_str(), "wb");
+    std::ofstream txtFile(workDir + "/benchmark_reads.txt");
+    if(fastqFile == Z_NULL || mappingFastqFile == Z_NULL || tsvFile == Z_NULL || !txtFile.is_open())
+    {
+        std::cerr << "ERROR: Could not write the benchmark data into " << workDir << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    //header of the demultiplexed reads is the pattern
+    std::string header;
+    std::string patterns = patternLine.substr(1, patternLine.length() - 2);
+    size_t pos = 0;
+    while((pos = patterns.find("][")) != std::string::npos)
+    {
+        header += patterns.substr(0, pos) + "\t";
+        patterns.erase(0, pos + 2);
+    }
+    header += patterns + "\n";
+    gzwrite(tsvFile, header.data(), header.length());
+
+    std::string record;
+    for(size_t read = 0; read < data.reads.size(); ++read)
+    {
+        const std::vector<std::string>& molecule = data.molecules[data.reads[read]];
+        std::string sequence;
+        for(const std::string& barcode : molecule)
+        {
+            sequence += barcode;
+        }
+        sequence = mutate_sequence(generator, sequence, 0.005);
+
+        record = "@read_" + std::to_string(read) + "\n" + sequence + "\n+\n" + std::string(sequence.length(), 'F') + "\n";
+        gzwrite(fastqFile, record.data(), record.length());
+        if(read < mappingReads){gzwrite(mappingFastqFile, record.data(), record.length());}
+        txtFile << sequence << "\n";
+
+        //demultiplexed reads keep only errors in the UMI
+        record.clear();
+        for(size_t i = 0; i < molecule.size(); ++i)
+        {
+            record += (i == 2) ? mutate_sequence(generator, molecule[i], 0.01) : molecule[i];
+            record += (i + 1 < molecule.size()) ? "\t" : "\n";
+        }
+        gzwrite(tsvFile, record.data(), record.length());
+    }
+    gzclose(fastqFile);
+    gzclose(mappingFastqFile);
+    gzclose(tsvFile);
+    txtFile.close();
+}
+
+//micro benchmarks of the mapping kernels and data structures
+void run_micro_benchmarks(BenchmarkRunner& runner, const benchmarkData& data, std::mt19937& generator)
+{
+    const size_t poolSize = 4096;
+    const size_t mask = poolSize - 1;
+
+    //levenshtein and match_pattern of the linker (23 bases, 2 mismatches) in the reads
+    std::vector<std::string> linkerSequences;
+    std::vector<std::string> readSequences;
+    std::vector<std::string> umiPairs;
+    std::vector<std::vector<std::string>> barcodeVectors;
+    for(size_t i = 0; i < poolSize; ++i)
+    {
+        const std::vector<std::string>& molecule = data.molecules[data.reads[i % data.reads.size()]];
+        linkerSequences.push_back(mutate_sequence(generator, linkers[0], 0.05));
+        std::string sequence;
+        for(const std::string& barcode : molecule)
+        {
+            sequence += barcode;
+        }
+        readSequences.push_back(mutate_sequence(generator, sequence, 0.005));
+        umiPairs.push_back(mutate_sequence(generator, molecule[2], 0.1));
+        barcodeVectors.push_back(molecule);
+    }
+
+    runner.run_micro("levenshtein", [&](const unsigned long long& iterations)
+    {
+        int start, end, score, endInPattern, startInPattern;
+        for(unsigned long long i = 0; i < iterations; ++i)
+        {
+            benchmarkSink += levenshtein(linkerSequences[i & mask], linkers[0], 2, start, end, score, endInPattern, startInPattern);
+        }
+    });
+
+    runner.run_micro("outputSense", [&](const unsigned long long& iterations)
+    {
+        int score;
+        for(unsigned long long i = 0; i < iterations; ++i)
+        {
+            benchmarkSink += outputSense(umiPairs[i & mask], barcodeVectors[i & mask][2], 2, score);
+        }
+    });
+
+    ConstantBarcode constantBarcode(linkers[0], 2);
+    runner.run_micro("ConstantBarcode::match_pattern", [&](const unsigned long long& iterations)
+    {
+        int start, end, score;
+        std::string realBarcode;
+        for(unsigned long long i = 0; i < iterations; ++i)
+        {
+            int differenceInBarcodeLength = 2;
+            benchmarkSink += constantBarcode.match_pattern(readSequences[i & mask], 8, start, end, score, realBarcode, differenceInBarcodeLength);
+        }
+    });
+
+    VariableBarcode variableBarcode(data.barcodes[0], 1);
+    runner.run_micro("VariableBarcode::match_pattern", [&](const unsigned long long& iterations)
+    {
+        int start, end, score;
+        std::string realBarcode;
+        for(unsigned long long i = 0; i < iterations; ++i)
+        {
+            int differenceInBarcodeLength = 1;
+            benchmarkSink += variableBarcode.match_pattern(readSequences[i & mask], 0, start, end, score, realBarcode, differenceInBarcodeLength);
+        }
+    });
+
+    //lookups of barcodes that r already in the set (the common case when mapping)
+    UniqueCharSet uniqueChars;
+    std::vector<std::string> uniqueStrings;
+    for(size_t i = 0; i < poolSize; ++i)
+    {
+        uniqueStrings.push_back(barcodeVectors[i][2] + barcodeVectors[i][3]);
+        uniqueChars.getHandle(uniqueStrings.back());
+    }
+    runner.run_micro("UniqueCharSet::getHandle", [&](const unsigned long long& iterations)
+    {
+        for(unsigned long long i = 0; i < iterations; ++i)
+        {
+            benchmarkSink += uniqueChars.getHandle(uniqueStrings[i & mask]);
+        }
+    });
+
+    runner.run_micro("DemultiplexedReads::addVector", [&](const unsigned long long& iterations)
+    {
+        DemultiplexedReads reads;
+        for(unsigned long long i = 0; i < iterations; ++i)
+        {
+            reads.addVector(barcodeVectors[i & mask]);
+        }
+        benchmarkSink += reads.size();
+    });
+}
+
+//macro benchmarks of the file policies, the mapping and the processing steps over all reads
+void run_macro_benchmarks(BenchmarkRunner& runner, const unsigned long long& reads,
+                          const unsigned long long& mappingReads, const int& threads, const std::string& workDir)
+{
+    const std::string fastqFile = workDir + "/benchmark_reads.fastq.gz";
+    const std::string txtFile = workDir + "/benchmark_reads.txt";
+    const std::string tsvFile = workDir + "/benchmark_demultiplexed.tsv.gz";
+    const std::string barcodeFile = workDir + "/benchmark_barcodes.txt";
+
+    runner.run_macro("ExtractLinesFromTxtFilesPolicy", reads, [](){}, [&]()
+    {
+        ExtractLinesFromTxtFilesPolicy policy;
+        policy.init_file(txtFile, "");
+        std::pair<std::string, std::string> line;
+        while(policy.get_next_line(line)){benchmarkSink += line.first.length();}
+        policy.close_file();
+    });
+
+    runner.run_macro("ExtractLinesFromFastqFilePolicy", reads, [](){}, [&]()
+    {
+        ExtractLinesFromFastqFilePolicy policy;
+        policy.init_file(fastqFile, "");
+        std::pair<std::string, std::string> line;
+        while(policy.get_next_line(line)){benchmarkSink += line.first.length();}
+        policy.close_file();
+    });
+
+    runner.run_macro("ExtractLinesFromFastqFilePolicy batches", reads, [](){}, [&]()
+    {
+        ExtractLinesFromFastqFilePolicy policy;
+        policy.init_file(fastqFile, "");
+        sequenceBatch batch;
+        while(policy.get_next_batch(batch, 4096))
+        {
+            for(const std::string_view& sequence : batch.forward){benchmarkSink += sequence.length();}
+        }
+        policy.close_file();
+    });
+
+    input mappingInput;
+    mappingInput.inFile = workDir + "/benchmark_mapping_reads.fastq.gz";
+    mappingInput.barcodeFile = barcodeFile;
+    mappingInput.patternLine = patternLine;
+    mappingInput.mismatchLine = mismatchLine;
+    mappingInput.threads = threads;
+    std::shared_ptr<Mapping<MapEachBarcodeSequentiallyPolicy, ExtractLinesFromFastqFilePolicy>> mapping;
+    runner.run_macro("demultiplexing/Mapping::run", mappingReads, [&]()
+    {
+        mapping = std::make_shared<Mapping<MapEachBarcodeSequentiallyPolicy, ExtractLinesFromFastqFilePolicy>>();
+    }, [&]()
+    {
+        mapping->run(mappingInput);
+    });
+    mapping.reset();
+
+    //processing: CI barcodes r the lines 0,2,3 of the barcode file, the AB the line 1
+    NBarcodeInformation barcodeIdData;
+    std::vector<std::string> abBarcodes;
+    std::vector<std::string> treatmentBarcodes;
+    std::streambuf* coutBuffer = std::cout.rdbuf(nullptr);
+    generateBarcodeDicts(barcodeFile, "0,2,3", barcodeIdData, abBarcodes, 1, &treatmentBarcodes, INT_MAX);
+    std::cout.rdbuf(coutBuffer);
+    std::unordered_map<std::string, std::string> proteinDict;
+    for(size_t i = 0; i < abBarcodes.size(); ++i)
+    {
+        proteinDict.insert(std::make_pair(abBarcodes[i], "AB_" + std::to_string(i)));
+    }
+
+    std::shared_ptr<BarcodeProcessingHandler> handler;
+    auto create_handler = [&]()
+    {
+        handler.reset();
+        handler = std::make_shared<BarcodeProcessingHandler>(barcodeIdData);
+        handler->addProteinData(proteinDict);
+    };
+    runner.run_macro("processing/parse_combined_file", reads, [&]()
+    {
+        create_handler();
+    }, [&]()
+    {
+        handler->parse_combined_file(tsvFile, threads);
+    });
+
+    for(const ReadGrouping& grouping : {ReadGrouping::hash, ReadGrouping::sort})
+    {
+        const std::string name = std::string("processing/processBarcodeMapping_") + (grouping == ReadGrouping::hash ? "hash" : "sort");
+        runner.run_macro(name, reads, [&]()
+        {
+            create_handler();
+            handler->setReadGrouping(grouping);
+            handler->parse_combined_file(tsvFile, threads);
+        }, [&]()
+        {
+            handler->processBarcodeMapping(1, threads);
+        });
+    }
+
+    runner.run_macro("processing/writeAbCountsPerSc", reads, [&]()
+    {
+        create_handler();
+        handler->parse_combined_file(tsvFile, threads);
+        handler->processBarcodeMapping(1, threads);
+    }, [&]()
+    {
+        handler->writeAbCountsPerSc(workDir + "/benchmark_processed.tsv");
+    });
+    handler.reset();
+}
+
+bool parse_arguments(char** argv, int argc, std::string& output, std::string& workDir, unsigned long long& reads, 
+                     unsigned long long& mappingReads, int& threads,
+                     int& repetitions, double& minTime, unsigned int& seed, std::string& filter, std::string& label)
+{
+    try
+    {
+        options_description desc("Options");
+        desc.add_options()
+            ("output,o", value<std::string>(&output)->default_value("./bin/benchmark.json"), "JSON file with the results of all benchmarks")
+            ("workDir,w", value<std::string>(&workDir)->default_value("./bin"), "directory for the generated reads and the output of the benchmarked tools")
+            ("reads,n", value<unsigned long long>(&reads)->default_value(200000), "number of generated reads for the macro benchmarks")
+            ("mappingReads,d", value<unsigned long long>(&mappingReads)->default_value(5000), "number of reads for the mapping benchmark \
+            (mapping is much slower than all other stages, these r the first reads of the generated reads)")
+            ("thread,t", value<int>(&threads)->default_value(1), "number of threads for the macro benchmarks")
+            ("repetitions,r", value<int>(&repetitions)->default_value(5), "repetitions of every benchmark, the median is reported")
+            ("minTime,m", value<double>(&minTime)->default_value(0.2), "minimum time in seconds of one repetition of a micro benchmark")
+            ("seed,s", value<unsigned int>(&seed)->default_value(42), "seed for the generated data")
+            ("filter,f", value<std::string>(&filter)->default_value(""), "run only benchmarks whose name contains this string")
+            ("label,l", value<std::string>(&label)->default_value(""), "label of this run in the JSON output (e.g. the commit)")
+
+            ("help,h", "help message");
+
+        variables_map vm;
+        store(parse_command_line(argc, argv, desc), vm);
+
+        if(vm.count("help"))
+        {
+            std::cout << desc << "\n";
+            std::cout << "EXAMPLE CALL:\n ./bin/benchmark -o ./bin/benchmark.json -n 200000 -t 4\n";
+            return false;
+        }
+
+        notify(vm);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::string output;
+    std::string workDir;
+    unsigned long long reads;
+    unsigned long long mappingReads;
+    int threads;
+    int repetitions;
+    double minTime;
+    unsigned int seed;
+    std::string filter;
+    std::string label;
+
+    if(!parse_arguments(argv, argc, output, workDir, reads, mappingReads, threads, repetitions, minTime, seed, filter, label))
+    {
+        exit(EXIT_FAILURE);
+    }
+    if(reads == 0 || mappingReads == 0)
+    {
+        std::cerr << "The number of reads must be greater than zero.\n";
+        exit(EXIT_FAILURE);
+    }
+    mappingReads = std::min(mappingReads, reads);
+
+    std::mt19937 generator(seed);
+    benchmarkData data;
+    generate_data(data, generator, reads);
+    write_data(data, generator, workDir, mappingReads);
+
+    BenchmarkRunner runner(repetitions, minTime, filter);
+    run_micro_benchmarks(runner, data, generator);
+    run_macro_benchmarks(runner, reads, mappingReads, threads, workDir);
+    runner.write_json(output, label, reads, mappingReads, threads, seed);
+
+    return(EXIT_SUCCESS);
+}
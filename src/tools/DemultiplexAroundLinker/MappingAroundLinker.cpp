@@ -33,8 +33,9 @@ void initialize_output(std::string output, const std::vector<std::pair<std::stri
 }
 
 /// write mapped barcodes to a tab separated file
-void write_file(const input& input, BarcodeMappingVector barcodes)
+void write_file(const input& input, const DemultiplexedReads& barcodes)
 {
+    TRACE_SPAN("io", "write demultiplexed reads");
     std::string output = input.outFile;
     std::ofstream outputFile;
     std::size_t found = output.find_last_of("/");
@@ -49,15 +50,19 @@ void write_file(const input& input, BarcodeMappingVector barcodes)
         output = output.substr(0,found) + "/" + "DemultiplexedAroundLinker_" + output.substr(found+1);
     }
     outputFile.open (output, std::ofstream::app);
-    for(int i = 0; i < barcodes.size(); ++i)
+    //barcodes r decoded read by read into one line
+    std::string line;
+    barcodes.for_each_read([&](const DemultiplexedReads::ReadView& read)
     {
-        for(int j = 0; j < barcodes.at(i).size(); ++j)
+        line.clear();
+        for(size_t j = 0; j < read.size(); ++j)
         {
-            outputFile << barcodes.at(i).at(j);
-            if(j!=barcodes.at(i).size()-1){outputFile << "\t";}
+            read.append_barcode(j, line);
+            if(j!=read.size()-1){line.push_back('\t');}
         }
-        outputFile << "\n";
-    }
+        line.push_back('\n');
+        outputFile << line;
+    });
     outputFile.close();
 }
 
@@ -78,11 +83,9 @@ void MappingAroundLinker<MappingPolicy, FilePolicy>::initialize_output_files(con
 template <typename MappingPolicy, typename FilePolicy>
 void MappingAroundLinker<MappingPolicy, FilePolicy>::demultiplex_wrapper(std::pair<const std::string&, const std::string&> line,
                                                             const input& input,
-                                                            std::atomic<unsigned long long>& lineCount,
-                                                            const unsigned long long& totalReadCount,
                                                             std::atomic<long long int>& elementsInQueue)
 {
-    this->demultiplex_read(line, input, lineCount, totalReadCount, false);
+    this->demultiplex_read(line, input, false);
     --elementsInQueue;
 }
 
@@ -96,25 +99,43 @@ void MappingAroundLinker<MappingPolicy, FilePolicy>::run_mapping(const input& in
     boost::asio::thread_pool pool(input.threads); //create thread pool
 
     //read line by line and add to thread pool
+    this->runReport.start_stage("read count");
     this->FilePolicy::init_file(input.inFile, input.reverseFile);
-    std::pair<std::string, std::string> line;
-    std::atomic<unsigned long long> lineCount = 0; //using atomic<int> as thread safe read count
+    this->runReport.end_stage("read count");
     std::atomic<long long int> elementsInQueue = 0;
     unsigned long long totalReadCount = FilePolicy::get_read_number();
-
-    while(FilePolicy::get_next_line(line))
+    std::unique_ptr<ProgressReporter> progress = this->start_progress_report(totalReadCount);
+
+    this->runReport.start_stage("mapping");
+    const size_t readingStage = this->runReport.stage("reading and decompression", true);
+    //reads r handed to the workers in batches of views into the blocks of the file (no copy of a read before the worker)
+    const size_t batchSize = this->batch_size(input);
+    TRACE_BATCH(readBatch, "io", "read batch", std::max<size_t>(1, 4096 / batchSize));
+    std::shared_ptr<sequenceBatch> batch = std::make_shared<sequenceBatch>();
+    while(this->runReport.time_part(readingStage, [&]{return FilePolicy::get_next_batch(*batch, batchSize);}))
     {
+        TRACE_BATCH_NEXT(readBatch);
         //wait to enqueue new elements in case we have a maximum bucket size
-        if(input.fastqReadBucketSize>0)
+        if(input.fastqReadBucketSize>0 && input.fastqReadBucketSize <= elementsInQueue)
         {
+            TRACE_SPAN("queue", "wait for full queue");
             while(input.fastqReadBucketSize <= elementsInQueue){}
         }
         //increase job count and push the job in the queue
-        ++elementsInQueue;
-        boost::asio::post(pool, std::bind(&MappingAroundLinker::demultiplex_wrapper, this, line, input, std::ref(lineCount), totalReadCount, std::ref(elementsInQueue)));
+        elementsInQueue += batch->size();
+        boost::asio::post(pool, [this, batch, &input, &elementsInQueue]
+        {
+            this->for_each_batch_read(*batch, [&](std::pair<const std::string&, const std::string&> line)
+            {
+                demultiplex_wrapper(line, input, elementsInQueue);
+            });
+        });
+        batch = std::make_shared<sequenceBatch>();
     }
     pool.join();
-    printProgress(1); std::cout << "\n"; // end the progress bar
+    this->runReport.end_stage("mapping", this->get_processed_reads(), this->get_processed_bytes());
+    this->runReport.add_counts("reading and decompression", this->get_processed_reads(), this->get_processed_bytes());
+    progress->stop(); // end the progress bar
     if(totalReadCount != ULLONG_MAX)
     {
         std::cout << "=>\tPERFECT MATCHES: " << std::to_string((unsigned long long)(100*(this->get_perfect_matches())/(double)totalReadCount)) 
@@ -140,10 +161,16 @@ void MappingAroundLinker<MappingPolicy, FilePolicy>::run(const input& input)
     initialize_output_files(input, pattern);
 
     //run mapping
+    this->runReport.set_tool("demultiplexAroundLinker", input.threads);
     this->run_mapping(input);
 
     //write the barcodes, failed lines, statistics (mismatches per barcode)
+    this->runReport.start_stage("writing");
     write_file(input, this->get_demultiplexed_ab_reads());
+    this->runReport.end_stage("writing", this->get_processed_reads());
+
+    this->write_run_report(input, {RunReport::output_file(input.outFile, "DemultiplexedAroundLinker_")});
+    TRACE_WRITE(input.outFile);
 }
 
 template class MappingAroundLinker<MapAroundConstantBarcodesAsAnchorPolicy, ExtractLinesFromFastqFilePolicy>;
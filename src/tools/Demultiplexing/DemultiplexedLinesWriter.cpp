@@ -2,7 +2,7 @@
 
 /// creates new files for failed lines, mapped barcodes (and writes header), statistics
 void initialize_output(std::string output, const std::vector<std::pair<std::string, char> > patterns, 
-                       std::string& guideNameTage, bool initializeGuideFile = false, bool guideFileHasUmi = false)
+                       std::string& guideNameTage, bool initializeGuideFile = false, bool guideFileHasUmi = false, bool countColumn = false)
 {
     //remove output
     std::string outputStats;
@@ -42,6 +42,7 @@ void initialize_output(std::string output, const std::vector<std::pair<std::stri
            outputFile << "\t";
         }
     }
+    if(countColumn){outputFile << "\tCOUNT";}
     outputFile << "\n";
     outputFile.close();
 
@@ -61,6 +62,7 @@ void initialize_output(std::string output, const std::vector<std::pair<std::stri
                 }
             }
         }
+        if(countColumn){outputFile << "\tCOUNT";}
         outputFile << "\n";
         outputFile.close();
     }
@@ -69,6 +71,7 @@ void initialize_output(std::string output, const std::vector<std::pair<std::stri
 /// write mismatches per barcode to file
 void write_stats(const input& input, const std::map<std::string, std::vector<int> >& statsMismatchDict)
 {
+    TRACE_SPAN("io", "write stats");
     std::string output = input.outFile;
     std::ofstream outputFile;
     std::size_t found = output.find_last_of("/");
@@ -165,8 +168,9 @@ void write_failed_line(const input& input, std::pair<const std::string&, const s
 }
 
 /// write mapped barcodes to a tab separated file
-void write_file(const input& input, BarcodeMappingVector barcodes, std::string nameTag = "")
+void write_file(const input& input, const DemultiplexedReads& barcodes, std::string nameTag = "")
 {
+    TRACE_SPAN("io", "write demultiplexed reads");
     std::string output = input.outFile;
     std::ofstream outputFile;
     std::size_t found = output.find_last_of("/");
@@ -181,14 +185,37 @@ void write_file(const input& input, BarcodeMappingVector barcodes, std::string n
         output = output.substr(0,found) + "/" + "Demultiplexed_" + nameTag + output.substr(found+1);
     }
     outputFile.open (output, std::ofstream::app);
-    for(int i = 0; i < barcodes.size(); ++i)
+    //barcodes r decoded read by read into one line
+    std::string line;
+    auto append_read = [&line](const DemultiplexedReads::ReadView& read)
     {
-        for(int j = 0; j < barcodes.at(i).size(); ++j)
+        line.clear();
+        for(size_t j = 0; j < read.size(); ++j)
         {
-            outputFile << barcodes.at(i).at(j);
-            if(j!=barcodes.at(i).size()-1){outputFile << "\t";}
+            read.append_barcode(j, line);
+            if(j!=read.size()-1){line.push_back('\t');}
         }
-        outputFile << "\n";
+    };
+    if(input.collapseOutput)
+    {
+        //identical reads r written once with their number of reads
+        barcodes.for_each_unique_read([&](const DemultiplexedReads::ReadView& read, const unsigned long long& count)
+        {
+            append_read(read);
+            line.push_back('\t');
+            line.append(std::to_string(count));
+            line.push_back('\n');
+            outputFile << line;
+        });
+    }
+    else
+    {
+        barcodes.for_each_read([&](const DemultiplexedReads::ReadView& read)
+        {
+            append_read(read);
+            line.push_back('\n');
+            outputFile << line;
+        });
     }
     outputFile.close();
 }
@@ -205,7 +232,7 @@ void DemultiplexedLinesWriter<MappingPolicy, FilePolicy>::initialize_output_file
     if(input.guideFile != ""){initializeGuideFile = true;}
     if(input.guideUMI){guideFileHasUmi = true;}
 
-    initialize_output(input.outFile, patterns, guideNameTage, initializeGuideFile, guideFileHasUmi);
+    initialize_output(input.outFile, patterns, guideNameTage, initializeGuideFile, guideFileHasUmi, input.collapseOutput);
 }
 
 
@@ -216,16 +243,14 @@ void DemultiplexedLinesWriter<MappingPolicy, FilePolicy>::initialize_output_file
 template <typename MappingPolicy, typename FilePolicy>
 void DemultiplexedLinesWriter<MappingPolicy, FilePolicy>::demultiplex_wrapper(std::pair<const std::string&, const std::string&> line,
                                                             const input& input,
-                                                            std::atomic<unsigned long long>& lineCount,
-                                                            const unsigned long long& totalReadCount,
                                                             std::atomic<long long int>& elementsInQueue)
 {
     //firstly try mapping an AB read
-    bool result = this->demultiplex_read(line, input, lineCount, totalReadCount, false);
+    bool result = this->demultiplex_read(line, input, false);
     if(!result && input.guideFile != "")
     {
         //run again this time mapping guide reads
-        result = this->demultiplex_read(line, input, lineCount, totalReadCount, true);
+        result = this->demultiplex_read(line, input, true);
     }
     if(!result && input.writeFailedLines)
     {
@@ -245,31 +270,50 @@ void DemultiplexedLinesWriter<MappingPolicy, FilePolicy>::run_mapping(const inpu
     boost::asio::thread_pool pool(input.threads); //create thread pool
 
     //read line by line and add to thread pool
+    this->runReport.start_stage("read count");
     this->FilePolicy::init_file(input.inFile, input.reverseFile);
-    std::pair<std::string, std::string> line;
-    std::atomic<unsigned long long> lineCount = 0; //using atomic<int> as thread safe read count
+    this->runReport.end_stage("read count");
     std::atomic<long long int> elementsInQueue = 0;
     unsigned long long totalReadCount = FilePolicy::get_read_number();
+    std::unique_ptr<ProgressReporter> progress = this->start_progress_report(totalReadCount);
 
-    while(FilePolicy::get_next_line(line))
+    this->runReport.start_stage("mapping");
+    const size_t readingStage = this->runReport.stage("reading and decompression", true);
+    //reads r handed to the workers in batches of views into the blocks of the file (no copy of a read before the worker)
+    const size_t batchSize = this->batch_size(input);
+    TRACE_BATCH(readBatch, "io", "read batch", std::max<size_t>(1, 4096 / batchSize));
+    std::shared_ptr<sequenceBatch> batch = std::make_shared<sequenceBatch>();
+    while(this->runReport.time_part(readingStage, [&]{return FilePolicy::get_next_batch(*batch, batchSize);}))
     {
+        TRACE_BATCH_NEXT(readBatch);
         //wait to enqueue new elements in case we have a maximum bucket size
-        if(input.fastqReadBucketSize>0)
+        if(input.fastqReadBucketSize>0 && input.fastqReadBucketSize <= elementsInQueue)
         {
+            TRACE_SPAN("queue", "wait for full queue");
             while(input.fastqReadBucketSize <= elementsInQueue){}
         }
         //increase job count and push the job in the queue
-        ++elementsInQueue;
-        boost::asio::post(pool, std::bind(&DemultiplexedLinesWriter::demultiplex_wrapper, this, line, input, std::ref(lineCount), totalReadCount, std::ref(elementsInQueue)));
+        elementsInQueue += batch->size();
+        boost::asio::post(pool, [this, batch, &input, &elementsInQueue]
+        {
+            this->for_each_batch_read(*batch, [&](std::pair<const std::string&, const std::string&> line)
+            {
+                demultiplex_wrapper(line, input, elementsInQueue);
+            });
+        });
+        batch = std::make_shared<sequenceBatch>();
     }
     pool.join();
-    printProgress(1); std::cout << "\n"; // end the progress bar
+    this->runReport.end_stage("mapping", this->get_processed_reads(), this->get_processed_bytes());
+    this->runReport.add_counts("reading and decompression", this->get_processed_reads(), this->get_processed_bytes());
+    progress->stop(); // end the progress bar
     if(totalReadCount != ULLONG_MAX)
     {
         std::cout << "=>\tPERFECT MATCHES: " << std::to_string((unsigned long long)(100*(this->get_perfect_matches())/(double)totalReadCount)) 
                 << "% | MODERATE MATCHES: " << std::to_string((unsigned long long)(100*(this->get_moderat_matches())/(double)totalReadCount))
                 << "% | MISMATCHES: " << std::to_string((unsigned long long)(100*(this->get_failed_matches())/(double)totalReadCount)) << "%\n";
     }
+    this->report_mapping_cache();
 
     FilePolicy::close_file();
 }
@@ -296,12 +340,23 @@ void DemultiplexedLinesWriter<MappingPolicy, FilePolicy>::run(const input& input
     }
 
     //run mapping
+    this->runReport.set_tool("demultiplexing", input.threads);
     this->run_mapping(input);
 
     //write the barcodes, failed lines, statistics (mismatches per barcode)
+    this->runReport.start_stage("writing");
     write_file(input, this->get_demultiplexed_ab_reads());
     write_file(input, this->get_demultiplexed_guide_reads(), guideNameTage);
     write_stats(input, this->get_mismatch_dict());
+    this->runReport.end_stage("writing", this->get_processed_reads());
+
+    this->write_run_report(input, {RunReport::output_file(input.outFile, "Demultiplexed_"), 
+                                   RunReport::output_file(input.outFile, "Demultiplexed_" + guideNameTage),
+                                   RunReport::output_file(input.outFile, "StatsMismatches_"), 
+                                   RunReport::output_file(input.outFile, "FailedLines_"),
+                                   RunReport::output_file(input.outFile, "FailedLines_1_"),
+                                   RunReport::output_file(input.outFile, "FailedLines_2_")});
+    TRACE_WRITE(input.outFile);
 }
 
 template class DemultiplexedLinesWriter<MapEachBarcodeSequentiallyPolicy, ExtractLinesFromFastqFilePolicy>;
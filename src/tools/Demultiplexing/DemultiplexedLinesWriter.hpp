@@ -13,8 +13,6 @@ class DemultiplexedLinesWriter : private Mapping<MappingPolicy, FilePolicy>
 
         void demultiplex_wrapper(std::pair<const std::string&, const std::string&> line,
                                 const input& input,
-                                std::atomic<unsigned long long>& lineCount,
-                                const unsigned long long& totalReadCount,
                                 std::atomic<long long int>& elementsInQueue);
         void initialize_output_files(const input& input,
                                      const std::vector<std::pair<std::string, char> >& patterns,
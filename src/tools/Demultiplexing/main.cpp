@@ -56,7 +56,7 @@ bool parse_arguments(char** argv, int argc, input& input)
         options_description desc("Options");
         desc.add_options()
             ("input,i", value<std::string>(&(input.inFile))->required(), "single file in fastq(.gz) format or the forward read file, if <-r> is also set for the\
-            reverse reads.")
+            reverse reads. Every record must have four lines, fastq files with sequences or qualities wrapped over several lines are not supported.")
             //optional for reverse mapping: no recommended, join reads first
             ("reverse,r", value<std::string>(&(input.reverseFile)), "Use this parameter for paired-end analysis as the reverse read file. <-i> is the forward read in \
             this case.")
@@ -81,10 +81,16 @@ bool parse_arguments(char** argv, int argc, input& input)
 
             ("threat,t", value<int>(&(input.threads))->default_value(5), "number of threads")
             ("fastqReadBucketSize,s", value<long long int>(&(input.fastqReadBucketSize))->default_value(-1), "number of lines of the fastQ file that should be read into RAM \
-            and be processed, before the next fastq read is processed. By default it equal 10X the thread number.")
+            and be processed, before the next fastq read is processed. Reads are handed to the threads in batches of this number divided by the threads \
+            (at most 4096 reads). By default it equal 4096X the thread number.")
             ("writeStats,q", value<bool>(&(input.writeStats))->default_value(false), "writing Statistics about the barcode mapping (mismatches in different barcodes). This only works for simple\
             mapping tasks without additional guide read mapping.\n")
             ("writeFailedLines,f", value<bool>(&(input.writeFailedLines))->default_value(false), "write failed lines to extra file\n")
+            ("mappingCache,k", value<unsigned long long>(&(input.mappingCacheSize))->default_value(0), "number of reads whose mapping outcome is cached, \
+            reads that r byte identical to a cached read (e.g. PCR duplicates) skip the barcode mapping. The hit rate is printed after mapping. \
+            Only for single-end reads, 0 disables the cache.\n")
+            ("collapseOutput,u", value<bool>(&(input.collapseOutput))->default_value(false), "write identical demultiplexed reads (same barcodes and UMI, \
+            e.g. PCR duplicates) only once, with the number of reads in an additional last column COUNT. Processing counts every line by this number.\n")
 
             ("help,h", "help message");
 
@@ -122,10 +128,11 @@ int main(int argc, char** argv)
     input input;
     if(parse_arguments(argv, argc, input))
     {
-        //set the number of reads in the processing queue by default to 10X number of threads
+        //set the number of reads in the processing queue by default to 4096X number of threads
+        //(reads r handed to the threads in batches of at most queue size / threads, so every thread gets batches of the max size of 4096 reads)
         if(input.fastqReadBucketSize == -1)
         {
-            input.fastqReadBucketSize = input.threads * 10;
+            input.fastqReadBucketSize = input.threads * 4096;
         }
         //check that we have the necessary parameters in case we also perform simultaniously guide mapping
         if(input.guideFile != "")
@@ -0,0 +1,453 @@
+#include "ReadGenerator.hpp"
+
+void FastqWriter::open(const std::string& fileName, const int& compressionLevel)
+{
+    if(fileName == "-")
+    {
+        output = stdout;
+    }
+    else if(endWith(fileName, ".gz"))
+    {
+        gzOutput = gzopen(fileName.c_str(), ("wb" + std::to_string(compressionLevel)).c_str());
+    }
+    else
+    {
+        output = fopen(fileName.c_str(), "wb");
+    }
+    if(gzOutput == Z_NULL && output == nullptr)
+    {
+        std::cerr << "ERROR: Could not open the output file: " << fileName << "\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+void FastqWriter::flush()
+{
+    if(buffer.empty()){return;}
+    bool written = (gzOutput != Z_NULL) ? (gzwrite(gzOutput, buffer.data(), buffer.size()) == (int)buffer.size())
+                                        : (fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size());
+    if(!written)
+    {
+        std::cerr << "ERROR: Could not write the reads (disk full or closed pipe?)\n";
+        exit(EXIT_FAILURE);
+    }
+    writtenBytes += buffer.size();
+    buffer.clear();
+}
+
+void FastqWriter::close()
+{
+    flush();
+    if(gzOutput != Z_NULL)
+    {
+        gzclose(gzOutput);
+        gzOutput = Z_NULL;
+    }
+    else if(output == stdout)
+    {
+        fflush(output);
+    }
+    else if(output != nullptr)
+    {
+        fclose(output);
+    }
+    output = nullptr;
+}
+
+std::string ReadGenerator::random_sequence(const int& length)
+{
+    const char bases[] = "ACGT";
+    std::string sequence(length, 'A');
+    uint64_t bits = 0;
+    for(int i = 0; i < length; ++i)
+    {
+        if((i & 31) == 0){bits = generator();}
+        sequence[i] = bases[bits & 3];
+        bits >>= 2;
+    }
+    return sequence;
+}
+
+void ReadGenerator::reverse_complement(const std::string& sequence, std::string& reverse)
+{
+    reverse.resize(sequence.length());
+    for(size_t i = 0; i < sequence.length(); ++i)
+    {
+        switch(sequence[sequence.length() - 1 - i])
+        {
+            case 'A': reverse[i] = 'T'; break;
+            case 'C': reverse[i] = 'G'; break;
+            case 'G': reverse[i] = 'C'; break;
+            default: reverse[i] = 'A'; break;
+        }
+    }
+}
+
+void ReadGenerator::parse_pattern()
+{
+    std::string patternLine = input.patternLine;
+    size_t start = 0;
+    int barcodeIdx = 0;
+    while((start = patternLine.find('[', start)) != std::string::npos)
+    {
+        size_t end = patternLine.find(']', start);
+        if(end == std::string::npos)
+        {
+            std::cerr << "ERROR: Pattern has an open bracket: " << patternLine << "\n";
+            exit(EXIT_FAILURE);
+        }
+        patternElement element;
+        element.sequence = patternLine.substr(start + 1, end - start - 1);
+        element.length = element.sequence.length();
+        if(element.sequence.find_first_not_of("ACGT") == std::string::npos){element.type = 'C';}
+        else if(element.sequence.find_first_not_of("N") == std::string::npos){element.type = 'N'; element.barcodeIdx = barcodeIdx++;}
+        else if(element.sequence.find_first_not_of("X") == std::string::npos){element.type = 'X';}
+        else if(element.sequence.find_first_not_of("D") == std::string::npos){element.type = 'D';}
+        else
+        {
+            std::cerr << "ERROR: Invalid pattern [" << element.sequence << "], use only ACGT, N, X or D within a bracket\n";
+            exit(EXIT_FAILURE);
+        }
+        if(element.length == 0)
+        {
+            std::cerr << "ERROR: Pattern has an empty bracket: " << patternLine << "\n";
+            exit(EXIT_FAILURE);
+        }
+        pattern.push_back(element);
+        start = end + 1;
+    }
+    if(pattern.empty())
+    {
+        std::cerr << "ERROR: Could not parse any bracket enclosed sequence from the pattern: " << patternLine << "\n";
+        exit(EXIT_FAILURE);
+    }
+    if(input.abIdx >= barcodeIdx || input.treatmentIdx >= barcodeIdx || (input.treatmentIdx >= 0 && input.treatmentIdx == input.abIdx))
+    {
+        std::cerr << "ERROR: The antibody and treatment index must be different [NNN] patterns (there r " << barcodeIdx << ")\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+void ReadGenerator::generate_barcodes()
+{
+    std::vector<int> barcodeLengths;
+    for(const patternElement& element : pattern)
+    {
+        if(element.type == 'N'){barcodeLengths.push_back(element.length);}
+    }
+
+    //read the whitelists
+    if(!input.barcodeFile.empty())
+    {
+        std::ifstream barcodeFileStream(input.barcodeFile);
+        if(!barcodeFileStream.is_open())
+        {
+            std::cerr << "ERROR: Could not open the barcode file: " << input.barcodeFile << "\n";
+            exit(EXIT_FAILURE);
+        }
+        for(std::string line; std::getline(barcodeFileStream, line);)
+        {
+            line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+            if(!line.empty()){barcodes.push_back(splitByDelimiter(line, ","));}
+        }
+        if(barcodes.size() != barcodeLengths.size())
+        {
+            std::cerr << "ERROR: The barcode file has " << barcodes.size() << " lines, but the pattern has " << barcodeLengths.size() << " [NNN] patterns\n";
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    //generate the whitelists, barcodes have a hamming distance of at least 3 if possible
+    std::vector<std::string> numbers = splitByDelimiter(input.barcodeNumbers, ",");
+    if(numbers.size() != 1 && numbers.size() != barcodeLengths.size())
+    {
+        std::cerr << "ERROR: Give one number of barcodes, or one for every [NNN] pattern (" << barcodeLengths.size() << ")\n";
+        exit(EXIT_FAILURE);
+    }
+    for(size_t i = 0; i < barcodeLengths.size(); ++i)
+    {
+        const unsigned long long number = std::stoull(numbers.size() == 1 ? numbers.front() : numbers.at(i));
+        const int length = barcodeLengths.at(i);
+        if(length < 32 && number > (1ULL << (2 * length)))
+        {
+            std::cerr << "ERROR: Can not generate " << number << " different barcodes of length " << length << "\n";
+            exit(EXIT_FAILURE);
+        }
+        std::vector<std::string> whitelist;
+        while(whitelist.size() < number)
+        {
+            std::string barcode;
+            for(int tries = 0; tries < 100; ++tries)
+            {
+                barcode = random_sequence(length);
+                bool distant = true;
+                for(const std::string& other : whitelist)
+                {
+                    int distance = 0;
+                    for(int j = 0; j < length && distance < 3; ++j){distance += (barcode[j] != other[j]);}
+                    if(distance < 3){distant = false; break;}
+                }
+                if(distant){break;}
+            }
+            if(std::find(whitelist.begin(), whitelist.end(), barcode) == whitelist.end()){whitelist.push_back(barcode);}
+        }
+        barcodes.push_back(whitelist);
+    }
+}
+
+void ReadGenerator::generate_cells()
+{
+    //signed rounds: input.abIdx is -1 if there is no AB round
+    const int rounds = barcodes.size();
+    for(int i = 0; i < rounds; ++i)
+    {
+        if(i != input.abIdx){++cellRounds;}
+    }
+    abNumber = (input.abIdx >= 0) ? barcodes.at(input.abIdx).size() : 1;
+
+    //every cell has a different combination of barcodes
+    double combinations = 1;
+    for(int i = 0; i < rounds; ++i)
+    {
+        if(i != input.abIdx){combinations *= barcodes[i].size();}
+    }
+    if(input.cells > combinations)
+    {
+        std::cerr << "ERROR: " << input.cells << " cells need more barcode combinations than the " << combinations << " of the whitelists\n";
+        exit(EXIT_FAILURE);
+    }
+    std::unordered_set<std::string> usedCombinations;
+    std::vector<int> cellCombination(cellRounds);
+    cellBarcodes.reserve(input.cells * cellRounds);
+    for(unsigned long long cell = 0; cell < input.cells;)
+    {
+        for(int i = 0, cellRound = 0; i < rounds; ++i)
+        {
+            if(i != input.abIdx){cellCombination[cellRound++] = generator() % barcodes[i].size();}
+        }
+        if(usedCombinations.insert(std::string((const char*)cellCombination.data(), cellRounds * sizeof(int))).second)
+        {
+            cellBarcodes.insert(cellBarcodes.end(), cellCombination.begin(), cellCombination.end());
+            ++cell;
+        }
+    }
+}
+
+void ReadGenerator::write_barcode_files()
+{
+    if(input.barcodeFile.empty())
+    {
+        std::ofstream barcodeFileStream(input.outPrefix + "_barcodes.txt");
+        for(const std::vector<std::string>& whitelist : barcodes)
+        {
+            for(size_t i = 0; i < whitelist.size(); ++i)
+            {
+                barcodeFileStream << whitelist[i] << ((i + 1 < whitelist.size()) ? "," : "\n");
+            }
+        }
+        barcodeFileStream.close();
+    }
+
+    //names of antibodies and treatments in the order of their barcodes
+    std::vector<std::pair<int, std::string>> nameFiles = {{input.abIdx, "_antibody.txt"}, {input.treatmentIdx, "_treatment.txt"}};
+    for(const std::pair<int, std::string>& nameFile : nameFiles)
+    {
+        if(nameFile.first < 0){continue;}
+        std::ofstream nameFileStream(input.outPrefix + nameFile.second);
+        const std::string namePrefix = (nameFile.first == input.abIdx) ? "AB_" : "TREATMENT_";
+        for(size_t i = 0; i < barcodes.at(nameFile.first).size(); ++i)
+        {
+            nameFileStream << namePrefix << i << ((i + 1 < barcodes.at(nameFile.first).size()) ? "," : "\n");
+        }
+        nameFileStream.close();
+    }
+}
+
+void ReadGenerator::new_molecule(molecule& mol)
+{
+    const unsigned long long cell = generator() % input.cells;
+    const unsigned long long ab = generator() % abNumber;
+    mol.truthKey = cell * abNumber + ab;
+    mol.written = false;
+    std::poisson_distribution<unsigned long long> duplicates(std::max(0.0, input.duplicationRate - 1));
+    mol.copies = 1 + ((input.duplicationRate > 1) ? duplicates(generator) : 0);
+
+    mol.sequence.clear();
+    int cellRound = 0;
+    for(const patternElement& element : pattern)
+    {
+        if(element.type == 'C'){mol.sequence += element.sequence;}
+        else if(element.type == 'X' || element.type == 'D'){mol.sequence += random_sequence(element.length);}
+        else if(element.barcodeIdx == input.abIdx){mol.sequence += barcodes[element.barcodeIdx][ab];}
+        else
+        {
+            mol.sequence += barcodes[element.barcodeIdx][cellBarcodes[cell * cellRounds + cellRound]];
+            ++cellRound;
+        }
+    }
+}
+
+void ReadGenerator::add_errors(const std::string& sequence, std::string& read)
+{
+    read.clear();
+    const double errorRate = input.substitutionRate + input.insertionRate + input.deletionRate;
+    if(errorRate <= 0)
+    {
+        read = sequence;
+        return;
+    }
+
+    //jump from error to error (distance between errors is geometric distributed)
+    const char bases[] = "ACGT";
+    std::geometric_distribution<unsigned long long> nextError(std::min(errorRate, 1.0));
+    std::uniform_real_distribution<double> errorType(0, errorRate);
+    size_t position = 0;
+    while(position < sequence.length())
+    {
+        const unsigned long long skip = nextError(generator);
+        if(skip >= sequence.length() - position)
+        {
+            read.append(sequence, position, std::string::npos);
+            break;
+        }
+        read.append(sequence, position, skip);
+        position += skip;
+
+        const double type = errorType(generator);
+        if(type < input.substitutionRate)
+        {
+            const char* base = strchr(bases, sequence[position]);
+            const int baseIdx = (base != nullptr) ? (base - bases) : 0;
+            read.push_back(bases[(baseIdx + 1 + generator() % 3) & 3]);
+            ++position;
+        }
+        else if(type < input.substitutionRate + input.insertionRate)
+        {
+            read.push_back(bases[generator() & 3]);
+        }
+        else
+        {
+            ++position; //deletion
+        }
+    }
+}
+
+void ReadGenerator::write_read(const unsigned long long& readId, const std::string& read)
+{
+    const bool pairedEnd = !input.reverseFile.empty();
+    const size_t length = (pairedEnd && input.readLength > 0) ? std::min<size_t>(input.readLength, read.length()) : read.length();
+
+    record.clear();
+    record += "@read_" + std::to_string(readId) + "\n";
+    record.append(read, 0, length);
+    record += "\n+\n";
+    record.append(length, 'F');
+    record += "\n";
+    forwardWriter.write(record);
+
+    if(pairedEnd)
+    {
+        reverse_complement(read.substr(read.length() - length), reverseRead);
+        record.clear();
+        record += "@read_" + std::to_string(readId) + "\n" + reverseRead + "\n+\n";
+        record.append(length, 'F');
+        record += "\n";
+        reverseWriter.write(record);
+    }
+}
+
+void ReadGenerator::write_ground_truth()
+{
+    std::ofstream truthFile(input.outPrefix + "_groundTruth.tsv");
+    truthFile << "AB_BARCODE\tSingleCell_BARCODE\tAB_COUNT\tTREATMENT\tREAD_COUNT\n";
+
+    //position of the treatment within the barcodes of a cell
+    int treatmentRound = -1;
+    const int rounds = barcodes.size();
+    for(int i = 0, cellRound = 0; i < rounds; ++i)
+    {
+        if(i == input.abIdx){continue;}
+        if(i == input.treatmentIdx){treatmentRound = cellRound;}
+        ++cellRound;
+    }
+
+    for(const std::pair<const unsigned long long, std::pair<unsigned long long, unsigned long long>>& truth : groundTruth)
+    {
+        const unsigned long long cell = truth.first / abNumber;
+        const unsigned long long ab = truth.first % abNumber;
+        std::string cellName;
+        for(int cellRound = 0; cellRound < cellRounds; ++cellRound)
+        {
+            cellName += std::to_string(cellBarcodes[cell * cellRounds + cellRound]) + ((cellRound + 1 < cellRounds) ? "." : "");
+        }
+        std::string treatment = (treatmentRound >= 0) ? "TREATMENT_" + std::to_string(cellBarcodes[cell * cellRounds + treatmentRound]) : "";
+        std::string abName = (input.abIdx >= 0) ? "AB_" + std::to_string(ab) : "";
+        truthFile << abName << "\t" << cellName << "\t" << truth.second.first << "\t" << treatment << "\t" << truth.second.second << "\n";
+    }
+    truthFile.close();
+}
+
+void ReadGenerator::run()
+{
+    //the reads might be streamed to stdout, all messages go to stderr then
+    std::ostream& log = (input.fastqFile == "-") ? std::cerr : std::cout;
+
+    parse_pattern();
+    generate_barcodes();
+    generate_cells();
+    write_barcode_files();
+
+    forwardWriter.open(input.fastqFile, input.compressionLevel);
+    if(!input.reverseFile.empty()){reverseWriter.open(input.reverseFile, input.compressionLevel);}
+
+    //reads r drawn from a window of molecules, a molecule is replaced by a new one once all its reads r written:
+    //by that duplicates of a molecule r spread over the file (like in a real sequencing run) without storing all molecules
+    const size_t windowSize = 4096;
+    std::vector<molecule> window(windowSize);
+    for(molecule& mol : window)
+    {
+        new_molecule(mol);
+    }
+
+    std::string read;
+    for(unsigned long long readId = 0; readId < input.reads; ++readId)
+    {
+        molecule& mol = window[generator() % windowSize];
+        add_errors(mol.sequence, read);
+        write_read(readId, read);
+
+        if(input.writeGroundTruth)
+        {
+            std::pair<unsigned long long, unsigned long long>& truth = groundTruth[mol.truthKey];
+            if(!mol.written){++truth.first;}
+            ++truth.second;
+        }
+        if(!mol.written){++totalMolecules;}
+        mol.written = true;
+        if(--mol.copies == 0){new_molecule(mol);}
+
+        if(readId % 1000000 == 0 && readId > 0)
+        {
+            log << "\t\r" << readId << " reads" << std::flush;
+        }
+    }
+    forwardWriter.close();
+    if(!input.reverseFile.empty()){reverseWriter.close();}
+
+    if(input.writeGroundTruth){write_ground_truth();}
+
+    //parameters for processing the generated reads
+    std::string ciIndices;
+    const int rounds = barcodes.size();
+    for(int i = 0; i < rounds; ++i)
+    {
+        if(i != input.abIdx){ciIndices += (ciIndices.empty() ? "" : ",") + std::to_string(i);}
+    }
+    log << "\t\r" << input.reads << " reads of " << totalMolecules << " UMIs (" << forwardWriter.get_written_bytes() + reverseWriter.get_written_bytes()
+        << " bytes) written\n";
+    log << "processing parameters: -b " << (input.barcodeFile.empty() ? input.outPrefix + "_barcodes.txt" : input.barcodeFile) << " -c " << ciIndices;
+    if(input.abIdx >= 0){log << " -a " << input.outPrefix << "_antibody.txt -x " << input.abIdx;}
+    if(input.treatmentIdx >= 0){log << " -d " << input.outPrefix << "_treatment.txt -y " << input.treatmentIdx;}
+    log << "\n";
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdio>
+#include <zlib.h>
+
+#include "helper.hpp"
+
+//stores all the input parameters for the read generator
+struct generatorInput
+{
+    std::string outPrefix; // prefix of the barcode, antibody, treatment and ground truth files
+    std::string patternLine; // same syntax as for demultiplexing: [ACGT..] constant, [NNN..] barcode, [XXX..] UMI, [DDD..] random insert
+    std::string fastqFile = ""; // forward reads, ends with .gz for gzipped output, '-' streams to stdout
+    std::string reverseFile = ""; // reverse reads (paired-end), reverse complement of the end of the read
+    int readLength = 0; // length of forward and reverse read in paired-end mode, 0 for the whole read
+    std::string barcodeFile = ""; // whitelist of barcodes for the [NNN] patterns, generated if empty
+    std::string barcodeNumbers = "96"; // number of generated barcodes per [NNN] pattern, comma seperated or one for all
+    int abIdx = -1; // the [NNN] pattern (0-indexed) of the antibody barcodes, -1 if there is no antibody
+    int treatmentIdx = -1; // the [NNN] pattern (0-indexed) of the treatment barcodes, -1 if there is no treatment
+
+    unsigned long long reads = 1000000;
+    unsigned long long cells = 1000;
+    double duplicationRate = 4; // mean number of reads (PCR duplicates) per UMI
+    double substitutionRate = 0.001; // per base error rates
+    double insertionRate = 0;
+    double deletionRate = 0;
+    unsigned int seed = 42;
+    int compressionLevel = 1;
+    bool writeGroundTruth = true;
+};
+
+//one bracket enclosed element of the pattern
+struct patternElement
+{
+    char type; // C constant, N barcode, X UMI, D random insert
+    std::string sequence; // constant sequence
+    int length;
+    int barcodeIdx = -1; // index of the whitelist for N patterns
+};
+
+/** @brief buffered output of fastq records into a plain or gzipped file (or stdout), the buffer is written in
+ * small chunks so that forward and reverse reads can be streamed through two named pipes into the demultiplexing
+ **/
+class FastqWriter
+{
+    public:
+        void open(const std::string& fileName, const int& compressionLevel);
+        void close();
+        inline void write(const std::string& record)
+        {
+            buffer.append(record);
+            if(buffer.size() >= chunkSize){flush();}
+        }
+        unsigned long long get_written_bytes() const
+        {
+            return writtenBytes;
+        }
+
+    private:
+        void flush();
+
+        static const size_t chunkSize = 1 << 14;
+        std::string buffer;
+        gzFile gzOutput = Z_NULL;
+        FILE* output = nullptr;
+        unsigned long long writtenBytes = 0;
+};
+
+/** @brief Generates reads of a combinatorial indexing experiment: cells have one barcode in every barcoding round, every UMI
+ * (a molecule of an antibody in a cell) is read several times (PCR duplicates) and all reads have sequencing errors.
+ * Reads r streamed (only a window of molecules is kept in memory, their duplicates r mixed within this window), besides the reads the
+ * barcode file, the antibody and treatment names and the ground truth (UMIs and reads per antibody and cell) r written
+ * in the format of the processing tool, so that the whole pipeline can be tested at any scale.
+ **/
+class ReadGenerator
+{
+    public:
+        ReadGenerator(const generatorInput& input) : input(input), generator(input.seed){}
+        void run();
+
+    private:
+        //a UMI of an antibody in a cell, the reads r copies of its sequence with errors
+        struct molecule
+        {
+            std::string sequence;
+            unsigned long long truthKey; // cell * number of antibodies + antibody
+            unsigned long long copies; // reads left to write
+            bool written; // true once the first read of the molecule is written
+        };
+
+        void parse_pattern();
+        void generate_barcodes();
+        void generate_cells();
+        void write_barcode_files();
+        void write_ground_truth();
+
+        void new_molecule(molecule& mol);
+        void add_errors(const std::string& sequence, std::string& read);
+        void write_read(const unsigned long long& readId, const std::string& read);
+        std::string random_sequence(const int& length);
+        void reverse_complement(const std::string& sequence, std::string& reverse);
+
+        generatorInput input;
+        std::mt19937_64 generator;
+        std::vector<patternElement> pattern;
+        std::vector<std::vector<std::string>> barcodes; // whitelist for every [NNN] pattern
+        std::vector<int> cellBarcodes; // barcode of every cell in all [NNN] patterns except the antibody (cells * cellRounds)
+        int cellRounds = 0;
+        size_t abNumber = 1;
+
+        //ground truth: number of UMIs and reads for every antibody and cell
+        std::unordered_map<unsigned long long, std::pair<unsigned long long, unsigned long long>> groundTruth;
+        unsigned long long totalMolecules = 0;
+
+        FastqWriter forwardWriter;
+        FastqWriter reverseWriter;
+        std::string record;
+        std::string reverseRead;
+};
@@ -0,0 +1,107 @@
+#include <boost/program_options.hpp>
+#include <boost/program_options/options_description.hpp>
+
+#include "ReadGenerator.hpp"
+using namespace boost::program_options;
+
+/**
+ * Tool to generate reads of a combinatorial indexing experiment for scaling tests of the whole pipeline.
+ *
+ * Reads follow the same pattern as for demultiplexing ([ACGT..] constant, [NNN..] barcode of a whitelist, [XXX..] UMI, [DDD..] random insert),
+ * cells have a random barcode in every [NNN] pattern except the antibody, every UMI of an antibody in a cell is read several times (PCR duplicates)
+ * and all reads get substitutions, insertions and deletions with the given per base rates.
+ * The reads r streamed into fastq(.gz) files (or stdout, or named pipes that demultiplexing reads from), besides the reads following files r written:
+ * <prefix>_barcodes.txt (if no barcode file is given), <prefix>_antibody.txt, <prefix>_treatment.txt and <prefix>_groundTruth.tsv
+ * with the true number of UMIs and reads per antibody and cell (same columns as the AB output of processing, cells r named by the ids of their barcodes).
+ *
+ * EXAMPLE: 10 million paired-end reads piped through demultiplexing without storing them
+ * mkfifo ./bin/sim_R1.fastq ./bin/sim_R2.fastq
+ * ./bin/readGenerator -o ./bin/sim -p [NNNNNNNN][CTTGTGGAAAGGACGAAACACCG][XXXXXXXXXX][NNNNNNNNNN][GTTTTAGAGCTAGAAATAGCAA][NNNNNNNN] -x 1 -n 10000000
+ *                     -f ./bin/sim_R1.fastq -r ./bin/sim_R2.fastq -l 60 &
+ * ./bin/demultiplexing -i ./bin/sim_R1.fastq -r ./bin/sim_R2.fastq -b ./bin/sim_barcodes.txt -p <same pattern> -m 1,2,1,1,2,1 -o ./bin/sim.tsv
+ * */
+
+bool parse_arguments(char** argv, int argc, generatorInput& input)
+{
+    try
+    {
+        options_description desc("Options");
+        desc.add_options()
+            ("output,o", value<std::string>(&(input.outPrefix))->required(), "prefix of the output files (barcodes, antibodies, treatments, ground truth and by default the reads)")
+            ("sequencePattern,p", value<std::string>(&(input.patternLine))->required(), "pattern of the reads, same as for demultiplexing: every substring \
+            is enclosed with square brackets. ACGT for a constant sequence, N for a barcode of the whitelist, X for a UMI and D for a random insert (e.g. cDNA). \
+            E.g.: [NNNNNNNN][AGAGCATGCCTTCAG][XXXXXXXXXX][NNNNNNNNNN]")
+            ("fastq,f", value<std::string>(&(input.fastqFile))->default_value(""), "file for the (forward) reads, gzipped if it ends with .gz, '-' writes \
+            the reads to stdout. By default <output>.fastq.gz")
+            ("reverse,r", value<std::string>(&(input.reverseFile))->default_value(""), "file for the reverse reads, generates paired-end reads. The reverse read \
+            is the reverse complement of the end of the read.")
+            ("readLength,l", value<int>(&(input.readLength))->default_value(0), "length of forward and reverse reads in paired-end mode, 0 for the whole read")
+            ("barcodeList,b", value<std::string>(&(input.barcodeFile))->default_value(""), "file with the whitelist of barcodes for every [NNN] pattern (comma \
+            seperated, one line per pattern like for demultiplexing). If not given the barcodes r generated and written to <output>_barcodes.txt")
+            ("barcodeNumbers,w", value<std::string>(&(input.barcodeNumbers))->default_value("96"), "number of generated barcodes for every [NNN] pattern, \
+            comma seperated or one number for all patterns")
+            ("antibodyIndex,x", value<int>(&(input.abIdx))->default_value(-1), "[NNN] pattern of the antibody barcodes (0 indexed), -1 for no antibody. \
+            All other [NNN] patterns r barcodes of the cells")
+            ("GroupingIndex,y", value<int>(&(input.treatmentIdx))->default_value(-1), "[NNN] pattern of the treatment barcodes (0 indexed), -1 for no treatment")
+
+            ("reads,n", value<unsigned long long>(&(input.reads))->default_value(1000000), "number of reads")
+            ("cells,c", value<unsigned long long>(&(input.cells))->default_value(1000), "number of cells")
+            ("duplicationRate,d", value<double>(&(input.duplicationRate))->default_value(4), "mean number of reads per UMI (PCR duplicates)")
+            ("substitutionRate,s", value<double>(&(input.substitutionRate))->default_value(0.001), "substitution rate per base")
+            ("insertionRate,i", value<double>(&(input.insertionRate))->default_value(0), "insertion rate per base")
+            ("deletionRate,e", value<double>(&(input.deletionRate))->default_value(0), "deletion rate per base")
+            ("seed,z", value<unsigned int>(&(input.seed))->default_value(42), "seed of the random generator")
+            ("compressionLevel,k", value<int>(&(input.compressionLevel))->default_value(1), "gzip compression level of .gz outputs (1 fastest, 9 smallest)")
+            ("groundTruth,g", value<bool>(&(input.writeGroundTruth))->default_value(true), "write the ground truth of UMIs and reads per antibody and cell, \
+            this needs memory for every antibody-cell combination")
+
+            ("help,h", "help message");
+
+        variables_map vm;
+        store(parse_command_line(argc, argv, desc), vm);
+
+        if(vm.count("help"))
+        {
+            std::cout << desc << "\n";
+            std::cout << "EXAMPLE CALL:\n ./bin/readGenerator -o ./bin/sim -p [NNNNNNNN][CTTGTGGAAAGGACGAAACACCG][XXXXXXXXXX][NNNNNNNNNN] -x 1 -n 1000000 -c 1000\n";
+            return false;
+        }
+
+        notify(vm);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    generatorInput input;
+    if(!parse_arguments(argv, argc, input))
+    {
+        exit(EXIT_FAILURE);
+    }
+    if(input.fastqFile.empty())
+    {
+        input.fastqFile = input.outPrefix + (input.reverseFile.empty() ? ".fastq.gz" : "_R1.fastq.gz");
+    }
+    if(input.cells == 0 || input.duplicationRate < 1 || input.substitutionRate < 0 || input.insertionRate < 0 || input.deletionRate < 0 ||
+       input.substitutionRate + input.insertionRate + input.deletionRate > 1)
+    {
+        std::cerr << "Parameter Error: need at least one cell, a duplication rate of at least 1 and error rates between 0 and 1.\n";
+        exit(EXIT_FAILURE);
+    }
+    if(!input.reverseFile.empty() && input.fastqFile == "-")
+    {
+        std::cerr << "Parameter Error: paired-end reads can not be written to stdout, use two (named pipe) files.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    ReadGenerator generator(input);
+    generator.run();
+
+    return(EXIT_SUCCESS);
+}
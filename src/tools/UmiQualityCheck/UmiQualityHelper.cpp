@@ -20,10 +20,11 @@ void UmiQuality::writeUmiQualityData(std::string output)
     outputFile.open (umiOutput);
 
     int count = 0;
-    for(auto key : umiQualStat.get_keys_in_order())
+    const std::vector<std::string> keys = umiQualStat.get_keys_in_order();
+    for(auto key : keys)
     {
         outputFile << key;
-        if(count==umiQualStat.get_keys_in_order().size()-1)
+        if(count==keys.size()-1)
         {
             outputFile << "\t" << "COUNT\n";
         }
@@ -53,105 +54,143 @@ void UmiQuality::writeUmiQualityData(std::string output)
     outputFile.close();
 }
 
-void addToMap(const std::string& key, const std::string& value, std::unordered_map<std::string, std::vector<std::string> >& uniqueBarcodes)
+std::vector<std::string> umiQualityStat::get_keys_in_order() const
 {
-    std::unordered_map<std::string, std::vector<std::string> >::iterator uniqueBarcodesIt = uniqueBarcodes.find(key);
-    //if the key already exists add to it
-    if( uniqueBarcodesIt != uniqueBarcodes.end())
+    bool hasValues = false;
+    errorMaps.for_each([&hasValues](const UmiErrorMap& errorMap){hasValues = hasValues || !errorMap.empty();});
+    if(!hasValues)
     {
-        //add value only if it is not already inside
-        if (!std::count(uniqueBarcodesIt->second.begin(), uniqueBarcodesIt->second.end(), value)) 
-        {
-            uniqueBarcodesIt->second.push_back(value);
-        }
-    }
-    else
-    {
-        std::vector<std::string> valueVec;
-        valueVec.push_back(value);
-        uniqueBarcodes.insert(std::make_pair(key, valueVec));
+        return(std::vector<std::string>());
     }
+
+    std::vector<std::string> barcodeOrder = barcodeNames;
+    std::sort(barcodeOrder.begin(),barcodeOrder.end(),compareFunction);//sort the vector
+    return(barcodeOrder);
 }
 
-void umiQualityStat::add_value(const std::unordered_map<std::string, std::vector<std::string> >& barcodesForUmi)
+UmiErrorMap umiQualityStat::get_error_map() const
 {
-    //generate key (number of different barcodes for each barcode(AB, BC1, BC2, ...) )
-    std::unordered_map<std::string, int> countMap; //map storing how many different barcodes we see in each BC-round(Ab,BC1, BC2,...)
-    for(const std::pair<std::string, std::vector<std::string>>& elem : barcodesForUmi)
+    //position of each sorted barcode type in the counts
+    std::vector<std::string> barcodeOrder = barcodeNames;
+    std::sort(barcodeOrder.begin(),barcodeOrder.end(),compareFunction);
+    std::vector<int> countPosition;
+    for(const std::string& barcodeName : barcodeOrder)
     {
-        int count = static_cast<int>(elem.second.size());
-        countMap.insert(std::make_pair(elem.first, count));
+        countPosition.push_back(std::find(barcodeNames.begin(), barcodeNames.end(), barcodeName) - barcodeNames.begin());
     }
 
-    std::lock_guard<std::mutex> guard(errorMapUpdateLock);
-    
-    if(errorMap.empty())
+    UmiErrorMap mergedMap;
+    std::vector<int> barcodeCountVector(countPosition.size());
+    errorMaps.for_each([&](const UmiErrorMap& errorMap)
     {
-        //add order of keys to 'barcodeOrder'
-        for(auto elem : countMap) 
+        for(const std::pair<const std::vector<int>, unsigned long long>& errorMapElem : errorMap)
         {
-            barcodeOrder.push_back(elem.first);
+            for(size_t i = 0; i < countPosition.size(); ++i)
+            {
+                barcodeCountVector[i] = errorMapElem.first.at(countPosition[i]);
+            }
+            ullong_save_add(mergedMap[barcodeCountVector], errorMapElem.second);
         }
-        std::sort(barcodeOrder.begin(),barcodeOrder.end(),compareFunction);//sort the vector
-    }
+    });
+    return(mergedMap);
+}
 
-    std::vector<int> barcodeCountVector;
-    for(auto barcodestring : barcodeOrder)
-    {
-        barcodeCountVector.push_back(countMap.at(barcodestring));
-    }
-    std::unordered_map< std::vector<int>, unsigned long long, VectorHasher>::iterator errorMapIt = errorMap.find(barcodeCountVector);
+void umiQualityStat::add_value(const std::vector<int>& barcodeCounts)
+{
+    UmiErrorMap& errorMap = errorMaps.local();
+    UmiErrorMap::iterator errorMapIt = errorMap.find(barcodeCounts);
     if( errorMapIt != errorMap.end())
     {
         ullong_save_add(errorMapIt->second, 1);
     }
     else
     {
-        errorMap.insert(std::make_pair(barcodeCountVector, 1));
+        errorMap.insert(std::make_pair(barcodeCounts, 1));
     }
 }
 
+//number of different AB/ treatment names (unique chars) in the vector
+int countDifferentNames(std::vector<const char*>& names)
+{
+    std::sort(names.begin(), names.end(), std::less<const char*>());
+    return(std::unique(names.begin(), names.end()) - names.begin());
+}
 
-void UmiQuality::checkUniquenessOfUmis(const std::vector<umiDataLinePtr>& uniqueUmiLines)
+void UmiQuality::checkUniquenessOfUmis(const readGroup& uniqueUmiLines)
 {
-    std::unordered_map<std::string, std::vector<std::string> > uniqueBarcodes; //maps string for Bc type (AB,BC1,...) => vector of all the possible barcode that we encounter
+    const dataLineArena& lines = rawData.getDataLines();
+    const std::vector<scKey>& radix = barcodeInformation.barcodeIdRadix;
+
+    //one bitset per CI barcoding round with a bit for every barcode id of this round, the set words r cleared after each UMI
+    //(all buffers r reused for all UMIs of this thread)
+    static thread_local std::vector<std::vector<uint64_t>> roundBarcodes;
+    static thread_local std::vector<std::pair<size_t, size_t>> setWords;
+    static thread_local std::vector<int> ciVec;
+    static thread_local std::vector<const char*> abNames;
+    static thread_local std::vector<const char*> treatmentNames;
+    static thread_local std::vector<int> barcodeCounts;
+    roundBarcodes.resize(radix.size());
+    for(size_t round = 0; round < radix.size(); ++round)
+    {
+        if(roundBarcodes[round].size() < (radix[round] + 63) / 64){roundBarcodes[round].resize((radix[round] + 63) / 64, 0);}
+    }
+    barcodeCounts.assign(radix.size() + 2, 0);
+    abNames.clear();
+    treatmentNames.clear();
 
-    //analyze each dataLine and store unique occurences of each barcode
-    for(const umiDataLinePtr& line : uniqueUmiLines)
+    //analyze each dataLine and count the different barcodes of each barcode type
+    for(const dataLineIdx& line : uniqueUmiLines)
     {
         //for all CI barcodes
-        std::vector<std::string> ciVec = splitByDelimiter(line->scID, ".");
-        int CiBcCount = 0;
-        for(const std::string& ciBarcodeId : ciVec)
+        singleCellIndexToBarcodeIds(lines.scID[line], barcodeInformation, ciVec);
+        for(size_t round = 0; round < ciVec.size(); ++round)
         {
-            std::string key = "CiIdx" + std::to_string(CiBcCount);
-            addToMap(key, ciBarcodeId, uniqueBarcodes);
-            ++CiBcCount;
+            uint64_t& word = roundBarcodes[round][ciVec[round] >> 6];
+            const uint64_t bit = uint64_t(1) << (ciVec[round] & 63);
+            if(!(word & bit))
+            {
+                if(word == 0){setWords.emplace_back(round, ciVec[round] >> 6);}
+                word |= bit;
+                ++barcodeCounts[round];
+            }
         }
 
-        //for Ab barcode
-        std::string abKey = "AB";
-        addToMap(abKey, line->abName, uniqueBarcodes);
-
-        //for Treatment barcode
-        std::string treatKey = "TREATMENT";
-        addToMap(treatKey, line->treatmentName, uniqueBarcodes);
+        //for Ab and Treatment barcode
+        abNames.push_back(lines.ab_name(line));
+        treatmentNames.push_back(lines.treatment_name(line));
     }
+    for(const std::pair<size_t, size_t>& setWord : setWords)
+    {
+        roundBarcodes[setWord.first][setWord.second] = 0;
+    }
+    setWords.clear();
+    barcodeCounts[radix.size()] = countDifferentNames(abNames);
+    barcodeCounts[radix.size() + 1] = countDifferentNames(treatmentNames);
 
-    //then safely add this information to 'umiQualityStat'
-    umiQualStat.add_value(uniqueBarcodes);
+    //then add this information to the errorMap of this thread
+    umiQualStat.add_value(barcodeCounts);
 }
 
 void UmiQuality::runUmiQualityCheck(const int& thread, const std::string& output)
 {
-    boost::asio::thread_pool pool(thread); //create thread pool
-    //Map of UMIs with duplicate Sc-Ab-treatments
-    for(std::pair<const char *const, std::vector<umiDataLinePtr>> dataLinesOfUmi : *rawData.getUniqueUmis())
+    //names of the counted barcode types, in the order of the counts in checkUniquenessOfUmis
+    std::vector<std::string> barcodeNames;
+    for(size_t round = 0; round < barcodeInformation.barcodeIdRadix.size(); ++round)
     {
-        //handing over only lineCount as reference, everything else will be copied (Mapping object as handed overr as this-pointer)
-        boost::asio::post(pool, std::bind(&UmiQuality::checkUniquenessOfUmis, this, dataLinesOfUmi.second));
+        barcodeNames.push_back("CiIdx" + std::to_string(round));
     }
-    pool.join();
+    barcodeNames.push_back("AB");
+    barcodeNames.push_back("TREATMENT");
+    umiQualStat.set_barcode_names(barcodeNames);
+
+    //Map of UMIs with duplicate Sc-Ab-treatments
+    //the line indices of each UMI r only referenced, the UMI groups r not changed anymore
+    std::vector<readGroup> umiGroups;
+    rawData.get_umi_groups(umiGroups, thread);
+    WorkStealingExecutor executor(thread);
+    executor.run(umiGroups.size(),
+                 [&](const size_t& i){checkUniquenessOfUmis(umiGroups[i]);},
+                 [&](const size_t& i){return((unsigned long long)umiGroups[i].size());});
 
     writeUmiQualityData(output);
-}
\ No newline at end of file
+}
@@ -1,6 +1,4 @@
 #include <iostream>
-#include <boost/asio/thread_pool.hpp>
-#include <boost/asio/post.hpp>
 
 #include "BarcodeProcessingHandler.hpp"
 #include "helper.hpp"
@@ -15,20 +13,23 @@ struct VectorHasher {
     }
 };
 
+typedef std::unordered_map< std::vector<int>, unsigned long long, VectorHasher> UmiErrorMap;
+
 class umiQualityStat
 {
     public:
-        // adds data to the errorMap
-        //input is following map: barcodeID(AB,BC1, bC2, ...) => vector of different barcodes found
-        void add_value(const std::unordered_map<std::string, std::vector<std::string> >& barcodesForUmi);
-        std::vector<std::string> get_keys_in_order()
-        {
-            return(barcodeOrder);
-        }
-        std::unordered_map< std::vector<int>, unsigned long long, VectorHasher> get_error_map()
+        //names of the barcode types (CiIdx0, CiIdx1, ..., AB, TREATMENT) in the order of the counts given to add_value
+        void set_barcode_names(const std::vector<std::string>& names)
         {
-            return(errorMap);
+            barcodeNames = names;
         }
+        // adds data to the errorMap of the calling thread
+        //input is the number of different barcodes found for a UMI for each barcode type
+        void add_value(const std::vector<int>& barcodeCounts);
+        //barcode types sorted by name (empty if no UMI was added)
+        std::vector<std::string> get_keys_in_order() const;
+        //errorMaps of all threads merged, the counts r in the order of get_keys_in_order
+        UmiErrorMap get_error_map() const;
 
     private:
         //Map to store where we have several barcodes for a UMI
@@ -37,10 +38,9 @@ class umiQualityStat
         // 1   | 2   | 1      | 1             => 100
         //e.g. we have many UMIs (92236) where the Sc-AB-treatment is truly unique
         //and 100 UMIs that have two different barcodes in BC-round 2
-        std::unordered_map< std::vector<int>, unsigned long long, VectorHasher> errorMap;
-        std::vector<std::string> barcodeOrder; // order of barcode types (AB, BC1, BC2, ...) in which the counts are stored in vector<int>
-        //above in the errorMap
-        std::mutex errorMapUpdateLock;
+        //every thread counts into its own map, they r merged when getting the map
+        ThreadLocalShards<UmiErrorMap> errorMaps;
+        std::vector<std::string> barcodeNames; // barcode types (AB, BC1, BC2, ...) in the order of the counts in the errorMaps
 };
 
 class UmiQuality
@@ -50,17 +50,20 @@ class UmiQuality
         UmiQuality(const BarcodeProcessingHandler& handler)
         {
             rawData = handler.getRawData();
+            barcodeInformation = handler.getBarcodeInformation();
         }
         //run the quality check: calls 1.) checkUniquenessOfUmis 2.) writeUmiQualityData
         void runUmiQualityCheck(const int& thread, const std::string& output);
 
     private:
     //private functions called in runUmiQualityCheck
-        void checkUniquenessOfUmis(const std::vector<umiDataLinePtr>& uniqueUmis);
+        void checkUniquenessOfUmis(const readGroup& uniqueUmis);
         void writeUmiQualityData(std::string output);
 
         //Statistic about the UMI quality
         umiQualityStat umiQualStat;
         //raw data: storing all demultiplexed dataLines
         UnprocessedDemultiplexedData rawData;
+        //barcode ids and their radix to get the CI-barcodes back from the single cell index
+        NBarcodeInformation barcodeInformation;
 };
\ No newline at end of file
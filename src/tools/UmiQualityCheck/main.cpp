@@ -165,6 +165,7 @@ int main(int argc, char** argv)
     NBarcodeInformation barcodeIdData;
     generateBarcodeDicts(barcodeFile, barcodeIndices, barcodeIdData, abBarcodes, abIdx, &treatmentBarcodes, treatmentIdx);
     BarcodeProcessingHandler dataParser(barcodeIdData);
+    dataParser.getRunReport().set_tool("umiqual", thread);
     //hack to prevent that the demultiplexed reads are written directly into the ScAb-matrix (which happens if the threshold to retains UMIs is set to 0)
     dataParser.setUmiFilterThreshold(-1.0);
 
@@ -180,12 +181,15 @@ int main(int argc, char** argv)
     }
     //parse the file of demultiplexed barcodes and
     //add all the data to the Unprocessed Demultiplexed Data (stored in rawData)
-    // (AB, treatment already are mapped to their real names, scID is a concatenation of numbers for each barcode in
-    //each abrcoding round, seperated by a dot)
+    // (AB, treatment already are mapped to their real names, scID is a mixed radix number with one digit for the barcode
+    //of each abrcoding round, it is only written as a dot seperated string in the output)
     dataParser.parse_combined_file(inFile, thread);
 
     UmiQuality umiCheck(dataParser);
+    dataParser.getRunReport().start_stage("UMI quality check");
     umiCheck.runUmiQualityCheck(thread, outFile);
+    dataParser.getRunReport().end_stage("UMI quality check");
+    dataParser.writeRunReport(outFile, {"UmiQualityCheck"});
 
     return(EXIT_SUCCESS);
 }
\ No newline at end of file